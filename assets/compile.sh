@@ -4,7 +4,7 @@ cd assets/shaders/ || exit
 
 for dir in */ ; do
     cd "$dir" || exit
-    for file in *.vert *.frag; do
+    for file in *.vert *.frag *.comp; do
         [ -e "$file" ] || continue
         glslc "$file" -o "${file}.spv"
     done
@@ -1,5 +1,12 @@
 #version 450 core
 
+// Feature toggles, set per pipeline permutation through
+// VkSpecializationInfo so the driver drops the disabled branches.
+layout(constant_id = 0) const bool USE_TEXTURE = true;
+layout(constant_id = 1) const bool USE_VERTEX_COLOR = false;
+layout(constant_id = 2) const bool SHOW_TEX_COORD = false;
+layout(constant_id = 3) const bool ALPHA_TEST = false;
+
 layout(binding = 1) uniform sampler2D texSampler;
 
 layout(location = 0) in vec3 fragColor;
@@ -8,9 +15,18 @@ layout(location = 1) in vec2 fragTexCoord;
 layout(location = 0) out vec4 outColor;
 
 void main() {
-  // outColor = vec4(fragColor, 1.0);
-  // outColor = vec4(fragTexCoord, 0.0, 1.0);
-  vec3 color = texture(texSampler, fragTexCoord).rgb;
-  // outColor = vec4(color * fragColor, 1.0);
-  outColor = vec4(color, 1.0);
+  vec4 color = vec4(1.0);
+  if (USE_TEXTURE) {
+    color = texture(texSampler, fragTexCoord);
+  }
+  if (USE_VERTEX_COLOR) {
+    color.rgb *= fragColor;
+  }
+  if (SHOW_TEX_COORD) {
+    color = vec4(fragTexCoord, 0.0, color.a);
+  }
+  if (ALPHA_TEST && color.a < 0.5) {
+    discard;
+  }
+  outColor = vec4(color.rgb, 1.0);
 }
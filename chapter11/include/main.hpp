@@ -1,13 +1,51 @@
 #pragma once
 
+#include <async_compute.hpp>
+#include <block_allocator.hpp>
+#include <command_cache.hpp>
 #include <common.hpp>
+#include <defragmenter.hpp>
+#include <deletion_queue.hpp>
+#include <frame_command_pools.hpp>
+#include <frame_latency.hpp>
+#include <host_allocator.hpp>
+#include <memory_report.hpp>
+#include <memory_tracker.hpp>
+#include <pipeline_cache.hpp>
+#include <pipeline_manager.hpp>
+#include <present_thread.hpp>
+#include <resource_pools.hpp>
+#include <shader_registry.hpp>
+#include <submit_scheduler.hpp>
+#include <triple_buffer.hpp>
+#include <uniform_ring.hpp>
+#include <upload_batch.hpp>
 #include <util.hpp>
+#include <worker_pool.hpp>
 
 namespace VulkanTutorial::Chapter11 {
 static char const *const TEXTURE_PATH =
     "assets/models/viking_room/viking_room.png";
 static char const *const MODEL_PATH =
     "assets/models/viking_room/viking_room.obj";
+static constexpr VkDeviceSize MEMORY_BLOCK_SIZE = 64ull * 1024 * 1024;
+static constexpr u64 DEFRAGMENTATION_INTERVAL = 300;
+static constexpr VkDeviceSize UNIFORM_RING_FRAME_SIZE = 256 * 1024;
+static constexpr u32 SIMULATION_RATE = 120; // Steps per second
+static constexpr u32 RECORDING_THREAD_LIMIT = 4;
+static constexpr u32 MIN_DRAWS_PER_RECORDING_TASK = 64;
+static constexpr u32 PIPELINE_COMPILE_THREADS = 2;
+// Bits of PipelineKey::features; bit i drives constant_id i in shader.frag.
+static constexpr u16 SHADER_FEATURE_TEXTURE = 0x1;
+static constexpr u16 SHADER_FEATURE_VERTEX_COLOR = 0x2;
+static constexpr u16 SHADER_FEATURE_TEX_COORD = 0x4;
+static constexpr u16 SHADER_FEATURE_ALPHA_TEST = 0x8;
+static constexpr u32 SHADER_FEATURE_COUNT = 4;
+static constexpr u32 CULL_DRAW_CAPACITY = 10240; // Per frame in flight
+static constexpr u32 CULL_GROUP_SIZE = 64;       // local_size_x in cull.comp
+static constexpr u32 RECORDING_BENCHMARK_DRAWS = 10000;
+static constexpr u32 MIN_FRAMES_IN_FLIGHT = 1;
+static constexpr u32 FRAMES_IN_FLIGHT_LIMIT = 4;
 
 struct Vertex {
   glm::vec3 pos;
@@ -39,11 +77,102 @@ struct UniformBufferObject {
   alignas(16) glm::mat4 proj;
 };
 
+struct PushConstants {
+  alignas(16) glm::mat4 mvp;
+};
+
+// Matches the std430 layouts in cull.comp. The culling pass writes
+// command.instanceCount, so draws outside the frustum become empty.
+struct alignas(16) CullDraw {
+  glm::vec4 sphere; // World-space center and radius
+  VkDrawIndexedIndirectCommand command;
+};
+
+struct CullConstants {
+  array<glm::vec4, 6> planes;
+  u32 drawCount;
+};
+
+struct DrawItem {
+  MeshHandle mesh{};
+  glm::mat4 model = glm::mat4(1.0f);
+};
+
+// One simulation step as seen by the render thread. Written by the simulation
+// thread and never modified after it is published.
+struct FrameSnapshot {
+  u64 step = 0;
+  glm::mat4 view = glm::mat4(1.0f);
+  float fovY = glm::radians(45.0f);
+  // Changes whenever the meshes or order of the draw list change. Transforms
+  // live in the uniform ring and do not count as a change.
+  u64 sceneVersion = 0;
+  vec<DrawItem> draws;
+};
+
+// PADDING marks the debug allocations that force a relocation; they never
+// move themselves.
+enum class MovableResource : u64 {
+  VERTEX_BUFFER = 0,
+  INDEX_BUFFER,
+  TEXTURE,
+  PADDING
+};
+
+struct Relocation {
+  MovableResource resource = MovableResource::VERTEX_BUFFER;
+  u64 frame = 0;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkImage image = VK_NULL_HANDLE;
+  VkImageView view = VK_NULL_HANDLE;
+  MemoryAllocation allocation{};
+};
+
+struct RetiredSwapchain {
+  VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+  vec<VkSemaphore> renderFinished;
+  // Frame submissions still to go before it is handed to the deletion queue.
+  u32 framesLeft = 0;
+};
+
 class App {
 private:
   bool mDebugMode = true;
+  bool mUsePushConstants = true;
+  // Picking or CPU culling need the mesh after upload; otherwise the CPU copy
+  // is dropped as soon as it lives on the GPU.
+  bool mKeepGeometryCopies = false;
+  // Frames, uploads and deferred deletion share one timeline semaphore when
+  // the device supports it; otherwise each frame waits on its own fence.
+  bool mUseTimelineSemaphore = true;
+  // Submits through vkQueueSubmit2 when synchronization2 is available;
+  // otherwise the scheduler falls back to vkQueueSubmit.
+  bool mUseSynchronization2 = true;
+  // Renders with vkCmdBeginRendering when dynamicRendering is available, so
+  // no render pass or framebuffers exist; otherwise the render pass is used.
+  bool mUseDynamicRendering = true;
+  // Sets cull mode, front face, topology and depth state per draw on Vulkan
+  // 1.3, and blend enable too with VK_EXT_extended_dynamic_state3, so only
+  // the remaining state needs its own pipeline. Otherwise all of it is baked.
+  bool mUseExtendedDynamicState = true;
+  // Presents from a separate thread so a blocking vkQueuePresentKHR overlaps
+  // with the next frame instead of stalling it.
+  bool mUsePresentThread = false;
+  // Logs draw recording time for every worker count after initialization.
+  bool mBenchmarkRecording = false;
+  // Replays command buffers recorded per (swapchain image, frame slot) while
+  // the scene version is unchanged. Push constants bake the transforms into
+  // the recording, so this needs the uniform path; the --cache-commands
+  // switch turns on both.
+  bool mCacheCommandBuffers = false;
+  // Opens a half-full block next to the mesh and texture blocks so the first
+  // defragmentation pass moves them, patching the descriptor sets on the way.
+  // Set with the --force-relocation switch.
+  bool mForceRelocation = false;
 
   SDL_Window *mWindow;
+  VkAllocationCallbacks const *mAllocator =
+      HostAllocator::get().getCallbacks();
   VkInstance mInstance = VK_NULL_HANDLE;
   VkDebugUtilsMessengerEXT mDebugMessenger = VK_NULL_HANDLE;
   VkSurfaceKHR mSurface = VK_NULL_HANDLE;
@@ -52,8 +181,29 @@ private:
   VkPhysicalDevice mPhysicalDevice = VK_NULL_HANDLE;
   VkDevice mDevice = VK_NULL_HANDLE;
 
+  bool mMemoryBudgetSupported = false;
+  MemoryTracker mMemoryTracker;
+  BlockAllocator mBlockAllocator;
+  Defragmenter mDefragmenter;
+  vec<Relocation> mPendingRelocations;
+  vec<MemoryAllocation> mRelocationPadding;
+  DeletionQueue mDeletionQueue;
+  SubmitScheduler mSubmitScheduler;
+
   VkQueue mGraphicsQueue = VK_NULL_HANDLE;
   VkQueue mPresentQueue = VK_NULL_HANDLE;
+  PresentThread mPresentThread;
+
+  QueueFamilyIndices mQueueFamilies;
+  bool mUseTransferQueue = false;
+  VkQueue mTransferQueue = VK_NULL_HANDLE;
+  VkCommandPool mTransferCommandPool = VK_NULL_HANDLE;
+  UploadBatch mUploadBatch;
+  // Culling runs on a compute family without graphics support when there is
+  // one, otherwise on the graphics queue.
+  u32 mComputeFamily = 0;
+  VkQueue mComputeQueue = VK_NULL_HANDLE;
+  AsyncCompute mAsyncCompute;
 
   VkSwapchainKHR mSwapchain = VK_NULL_HANDLE;
   vec<VkImage> mSwapchainImages;
@@ -61,20 +211,42 @@ private:
   VkExtent2D mSwapchainExtent;
   vec<VkImageView> mSwapchainImageViews;
 
+  VkFormat mDepthFormat = VK_FORMAT_UNDEFINED;
   VkRenderPass mRenderPass = VK_NULL_HANDLE;
   VkDescriptorSetLayout mDescriptorSetLayout = VK_NULL_HANDLE;
   VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
+  PipelineCache mPipelineCache;
+  VkShaderModule mVertShaderModule = VK_NULL_HANDLE;
+  VkShaderModule mFragShaderModule = VK_NULL_HANDLE;
+  PipelineManager mPipelineManager;
+  // The permutation to draw with (toggled from the keyboard) and the one
+  // compiled up front that stands in while it is not ready.
+  PipelineKey mPipelineKey;
+  PipelineKey mDefaultPipelineKey;
+  // Pipeline the current frame is recorded with.
   VkPipeline mGraphicsPipeline = VK_NULL_HANDLE;
+  // Loaded when blend enable is dynamic state as well.
+  PFN_vkCmdSetColorBlendEnableEXT mCmdSetColorBlendEnable = nullptr;
+  VkDescriptorSetLayout mCullSetLayout = VK_NULL_HANDLE;
+  VkPipelineLayout mCullPipelineLayout = VK_NULL_HANDLE;
+  VkPipeline mCullPipeline = VK_NULL_HANDLE;
   vec<VkFramebuffer> mSwapchainFramebuffers;
 
   VkCommandPool mCommandPool = VK_NULL_HANDLE;
-  vec<VkCommandBuffer> mCommandBuffers = {};
 
-  u32 mMipLevels = 1;
-  VkImage mTexture = VK_NULL_HANDLE;
-  VkDeviceMemory mTextureMemory = VK_NULL_HANDLE;
-  VkImageView mTextureImageView = VK_NULL_HANDLE;
-  VkSampler mTextureSampler = VK_NULL_HANDLE;
+  // Large draw lists are split across these workers. Frame command buffers
+  // come from mFrameCommandPools: thread 0 is the main thread, worker i
+  // records with thread i + 1.
+  WorkerPool mRecordingWorkers;
+  FrameCommandPools mFrameCommandPools;
+  CommandCache mCommandCache;
+
+  BufferPool mBuffers;
+  ImagePool mImages;
+  MeshPool mMeshes;
+  TexturePool mTextures;
+  MeshHandle mMesh{};
+  TextureHandle mTexture{};
 
   VkImage mColorImage = VK_NULL_HANDLE;
   VkDeviceMemory mColorImageMemory = VK_NULL_HANDLE;
@@ -86,23 +258,45 @@ private:
 
   vec<Vertex> mVertices;
   vec<u32> mIndices;
-  VkBuffer mVertexBuffer = VK_NULL_HANDLE;
-  VkDeviceMemory mVertexBufferMemory = VK_NULL_HANDLE;
-  VkBuffer mIndexBuffer = VK_NULL_HANDLE;
-  VkDeviceMemory mIndexBufferMemory = VK_NULL_HANDLE;
-
-  vec<VkBuffer> mUniformBuffers;
-  vec<VkDeviceMemory> mUniformBuffersMemory;
-  vec<void *> mUniformBuffersMapped;
+  // What tinyobj held while the model was parsed, freed once loaded.
+  u64 mModelParseBytes = 0;
+
+  UniformRing mUniformRing;
+  vec<u32> mUniformOffsets; // One per draw in the current snapshot
+  glm::mat4 mViewProj = glm::mat4(1.0f);
+
+  // Host-written draw commands, one region per frame in flight, whose
+  // instance counts the culling pass fills in.
+  VkBuffer mCullBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory mCullMemory = VK_NULL_HANDLE;
+  u8 *mCullMapped = nullptr;
+  VkDeviceSize mCullFrameSize = 0;
+
+  TripleBuffer<FrameSnapshot> mSnapshots;
+  std::thread mSimulationThread;
+  std::atomic<bool> mSimulationRunning = false;
+  // Owned by the simulation thread; bumped whenever it edits the draw list.
+  u64 mSceneVersion = 1;
 
   VkDescriptorPool mDescriptorPool = VK_NULL_HANDLE;
   vec<VkDescriptorSet> mDescriptorSets;
+  vec<bool> mDescriptorSetsDirty;
+  vec<VkDescriptorSet> mCullDescriptorSets;
 
   vec<VkSemaphore> mImageAvailableSemaphores = {};
   vec<VkSemaphore> mRenderFinishedSemaphores = {};
+  // Replaced swapchains and the semaphores their last presents wait on,
+  // kept until enough later frames have been submitted.
+  vec<RetiredSwapchain> mRetiredSwapchains;
   vec<VkFence> mInFlightFences = {};
+  vec<u64> mFrameSubmissions = {};
+  FrameLatency mFrameLatency;
 
+  // Fewer frames in flight lower input-to-display latency, more keep the GPU
+  // busier. Set once at startup.
+  u32 mFramesInFlight = MAX_FRAMES_IN_FLIGHT;
   u32 mCurrentFrame = 0;
+  u64 mFrameCount = 0;
   bool mFramebufferResized = false;
 
 private:
@@ -143,7 +337,7 @@ private:
   void createSwapchain();
   void createImageViews();
 
-  VkShaderModule createShaderModule(vec<char> const &code);
+  VkShaderModule createShaderModule(ShaderCode const &code);
 
   void createCommandPool();
 
@@ -156,27 +350,47 @@ private:
   void createRenderPass();
   void createDescriptorSetLayout();
   void createGraphicsPipeline();
+  PipelineKey getCompiledKey(PipelineKey const &key) const;
+  PipelineTarget getPipelineTarget() const;
+  VkPipeline buildGraphicsPipeline(PipelineKey const &key,
+                                   PipelineTarget const &target);
+  void createCullPipeline();
   void createColorResources();
   void createDepthResources();
   void createFramebuffers();
 
   u32 findMemoryType(u32 typeFilter, VkMemoryPropertyFlags properties);
+  VkBuffer createBufferObject(VkDeviceSize size, VkBufferUsageFlags usage);
+  void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                    VkMemoryPropertyFlags properties, MemoryCategory category,
+                    VkBuffer &buffer, VkDeviceMemory &bufferMemory);
   void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                    VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                    VkDeviceMemory &bufferMemory);
-  VkCommandBuffer beginSingleTimeCommands();
-  void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+                    VkMemoryPropertyFlags properties, MemoryCategory category,
+                    MovableResource resource, VkBuffer &buffer,
+                    MemoryAllocation &allocation);
+  void createUploadBatch();
+  void retireStagingBuffer(VkBuffer buffer, VkDeviceMemory memory);
   void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
+  VkImage createImageObject(u32 width, u32 height, u32 mipLevels,
+                            VkSampleCountFlagBits samples, VkFormat format,
+                            VkImageTiling tiling, VkImageUsageFlags usage);
+  void createImage(u32 width, u32 height, u32 mipLevels,
+                   VkSampleCountFlagBits samples, VkFormat format,
+                   VkImageTiling tiling, VkImageUsageFlags usage,
+                   VkMemoryPropertyFlags properties, MemoryCategory category,
+                   VkImage &image, VkDeviceMemory &imageMemory);
   void createImage(u32 width, u32 height, u32 mipLevels,
                    VkSampleCountFlagBits samples, VkFormat format,
                    VkImageTiling tiling, VkImageUsageFlags usage,
-                   VkMemoryPropertyFlags properties, VkImage &image,
-                   VkDeviceMemory &imageMemory);
+                   VkMemoryPropertyFlags properties, MemoryCategory category,
+                   MovableResource resource, VkImage &image,
+                   MemoryAllocation &allocation);
   void transitionImageLayout(VkImage image, VkFormat format,
                              VkImageLayout oldLayout, VkImageLayout newLayout,
                              u32 mipLevels);
-  void copyBufferToImage(VkBuffer buffer, VkImage image, u32 width, u32 height);
+  void copyBufferToImage(VkBuffer buffer, VkImage image, u32 width, u32 height,
+                         u32 mipLevels);
   void generateMipmaps(VkImage image, VkFormat imageFormat, i32 texWidth,
                        i32 texHeight, u32 mipLevels);
 
@@ -186,31 +400,72 @@ private:
 
   void loadModel();
 
-  void createVertexBuffer();
-  void createIndexBuffer();
+  BufferHandle createGeometryBuffer(void const *data, VkDeviceSize size,
+                                    VkBufferUsageFlags usage,
+                                    MovableResource resource);
+  void createMesh();
+  void releaseGeometryCopies();
   void createUniformBuffers();
+  void createCullBuffer();
+  VkDeviceSize getCullCommandOffset(u32 frame, u32 draw) const;
 
   void createDescriptorPool();
+  void updateDescriptorSet(u32 index);
   void createDescriptorSets();
 
+  void recordBufferRelocation(VkCommandBuffer commandBuffer, VkBuffer src,
+                              VkBuffer dst, VkDeviceSize size);
+  void recordImageRelocation(VkCommandBuffer commandBuffer, ImageHandle src,
+                             VkImage dst);
+  void padForRelocation(MemoryAllocation const &allocation);
+  BufferHandle getMovableBuffer(MovableResource resource) const;
+  bool relocateResource(VkCommandBuffer commandBuffer, u64 userData,
+                        MemoryAllocation const &allocation,
+                        vec<u32> const &sourceBlocks);
+  void destroyRelocation(Relocation const &relocation);
+  void updateRelocations();
+
+  MemoryReport createMemoryReport() const;
+  void destroyResources();
+
   void createCommandBuffers();
-  void recordCommandBuffer(VkCommandBuffer commandBuffer, u32 imageIndex);
+  u32 getRecordingTaskCount(u32 drawCount) const;
+  void recordDraws(VkCommandBuffer commandBuffer, FrameSnapshot const &snapshot,
+                   u32 first, u32 count);
+  void beginRendering(VkCommandBuffer commandBuffer, u32 imageIndex,
+                      bool secondaries);
+  void endRendering(VkCommandBuffer commandBuffer, u32 imageIndex);
+  VkCommandBuffer recordSecondaryDraws(u32 task, u32 taskCount, u32 imageIndex,
+                                      FrameSnapshot const &snapshot);
+  void benchmarkRecording();
+  void recordRelocationPass(VkCommandBuffer commandBuffer);
+  void recordCommandBuffer(VkCommandBuffer commandBuffer, u32 imageIndex,
+                           FrameSnapshot const &snapshot, bool cached = false);
 
   void createSyncObjects();
+  void createRenderFinishedSemaphores();
+  void retireSwapchains(u64 submission, bool all);
 
   void cleanupSwapchain();
   void recreateSwapchain();
 
   void initVulkan();
   bool pollEvents();
-  void updateUniformBuffer(u32 currentImage);
+  void handleKey(SDL_Keycode key);
+  void simulate(FrameSnapshot &snapshot, u64 step, float time);
+  void startSimulation();
+  void stopSimulation();
+  void updateUniformBuffer(u32 currentImage, FrameSnapshot const &snapshot);
+  VkSemaphore dispatchCulling(FrameSnapshot const &snapshot);
   void drawFrame();
   void mainLoop();
   void cleanup();
 
 public:
   App(int const &width = WINDOW_WIDTH, int const &height = WINDOW_HEIGHT,
-      str const &title = "Vulkan Tutorial", bool debugMode = true);
+      str const &title = "Vulkan Tutorial", bool debugMode = true,
+      u32 framesInFlight = MAX_FRAMES_IN_FLIGHT,
+      bool cacheCommandBuffers = false, bool forceRelocation = false);
   ~App();
 
   void run();
@@ -218,4 +473,4 @@ public:
 
 } // namespace VulkanTutorial::Chapter11
 
-int main();
+int main(int argc, char **argv);
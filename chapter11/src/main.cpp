@@ -143,7 +143,7 @@ void App::createInstance(str const &appName, u32 const &appVersion) {
   vkEnumerateInstanceExtensionProperties(nullptr, &extCount,
                                          availableExtensions.data());
 
-  if (vkCreateInstance(&createInfo, nullptr, &mInstance) != VK_SUCCESS) {
+  if (vkCreateInstance(&createInfo, mAllocator, &mInstance) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create Vulkan instance.");
   }
 }
@@ -154,7 +154,7 @@ VkResult App::createDebugUtilsMessengerEXT(
   auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
       mInstance, "vkCreateDebugUtilsMessengerEXT");
   if (func != nullptr) {
-    return func(mInstance, pCreateInfo, nullptr, &mDebugMessenger);
+    return func(mInstance, pCreateInfo, pAllocator, &mDebugMessenger);
   } else {
     return VK_ERROR_EXTENSION_NOT_PRESENT;
   }
@@ -165,7 +165,7 @@ App::destroyDebugUtilsMessengerEXT(VkAllocationCallbacks const *pAllocator) {
   auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
       mInstance, "vkDestroyDebugUtilsMessengerEXT");
   if (func != nullptr && mDebugMessenger != VK_NULL_HANDLE) {
-    func(mInstance, mDebugMessenger, nullptr);
+    func(mInstance, mDebugMessenger, pAllocator);
     mDebugMessenger = VK_NULL_HANDLE;
     return VK_SUCCESS;
   } else {
@@ -181,13 +181,14 @@ void App::setupDebugMessenger() {
   VkDebugUtilsMessengerCreateInfoEXT createInfo{};
   this->populateDebugMessengerCreateInfo(createInfo);
 
-  if (this->createDebugUtilsMessengerEXT(&createInfo, nullptr) != VK_SUCCESS) {
+  if (this->createDebugUtilsMessengerEXT(&createInfo, mAllocator) !=
+      VK_SUCCESS) {
     throw std::runtime_error("Failed to set up debug messenger.");
   }
 }
 
 void App::createSurface() {
-  if (!SDL_Vulkan_CreateSurface(mWindow, mInstance, nullptr, &mSurface)) {
+  if (!SDL_Vulkan_CreateSurface(mWindow, mInstance, mAllocator, &mSurface)) {
     throw std::runtime_error("Failed to create window surface.");
   }
 }
@@ -221,6 +222,28 @@ QueueFamilyIndices App::findQueueFamilies(VkPhysicalDevice device) {
     ++index;
   }
 
+  // A family with transfer but no graphics or compute support is usually
+  // backed by the DMA engines and can copy while the graphics queue renders.
+  for (u32 i = 0; i < queueFamilyCount; ++i) {
+    VkQueueFlags flags = queueFamilies[i].queueFlags;
+    if (queueFamilies[i].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) &&
+        !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      indices.transferFamily = i;
+      break;
+    }
+  }
+
+  // A compute family without graphics support runs on the async compute
+  // engines and can overlap with rasterization.
+  for (u32 i = 0; i < queueFamilyCount; ++i) {
+    VkQueueFlags flags = queueFamilies[i].queueFlags;
+    if (queueFamilies[i].queueCount > 0 && (flags & VK_QUEUE_COMPUTE_BIT) &&
+        !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+      indices.computeFamily = i;
+      break;
+    }
+  }
+
   return indices;
 }
 
@@ -378,9 +401,54 @@ void App::createLogicalDevice() {
   createInfo.queueCreateInfoCount = queueCreateInfos.size();
   createInfo.pEnabledFeatures = &deviceFeatures;
 
-  createInfo.enabledExtensionCount =
-      sizeof(DEVICE_EXTENSIONS) / sizeof(DEVICE_EXTENSIONS[0]);
-  createInfo.ppEnabledExtensionNames = DEVICE_EXTENSIONS;
+  mUseTimelineSemaphore = mUseTimelineSemaphore &&
+                          Util::isTimelineSemaphoreSupported(mPhysicalDevice);
+  VkPhysicalDeviceVulkan12Features features12{};
+  features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  features12.timelineSemaphore = VK_TRUE;
+  mUseSynchronization2 = mUseSynchronization2 &&
+                         Util::isSynchronization2Supported(mPhysicalDevice);
+  mUseDynamicRendering = mUseDynamicRendering &&
+                         Util::isDynamicRenderingSupported(mPhysicalDevice);
+  VkPhysicalDeviceVulkan13Features features13{};
+  features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  features13.synchronization2 = mUseSynchronization2;
+  features13.dynamicRendering = mUseDynamicRendering;
+  if (mUseSynchronization2 || mUseDynamicRendering) {
+    createInfo.pNext = &features13;
+  }
+  if (mUseTimelineSemaphore) {
+    features12.pNext = const_cast<void *>(createInfo.pNext);
+    createInfo.pNext = &features12;
+  }
+  mUseExtendedDynamicState =
+      mUseExtendedDynamicState &&
+      Util::isExtendedDynamicStateSupported(mPhysicalDevice);
+  bool dynamicBlendEnable =
+      mUseExtendedDynamicState &&
+      Util::isDynamicColorBlendEnableSupported(mPhysicalDevice);
+  VkPhysicalDeviceExtendedDynamicState3FeaturesEXT features3{};
+  features3.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+  features3.extendedDynamicState3ColorBlendEnable = VK_TRUE;
+  if (dynamicBlendEnable) {
+    features3.pNext = const_cast<void *>(createInfo.pNext);
+    createInfo.pNext = &features3;
+  }
+
+  vec<char const *> extensions(std::begin(DEVICE_EXTENSIONS),
+                               std::end(DEVICE_EXTENSIONS));
+  mMemoryBudgetSupported = Util::isDeviceExtensionSupported(
+      mPhysicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (mMemoryBudgetSupported) {
+    extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+  if (dynamicBlendEnable) {
+    extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+  }
+
+  createInfo.enabledExtensionCount = static_cast<u32>(extensions.size());
+  createInfo.ppEnabledExtensionNames = extensions.data();
 
   if (mDebugMode) {
     createInfo.enabledLayerCount =
@@ -390,16 +458,43 @@ void App::createLogicalDevice() {
     createInfo.enabledLayerCount = 0;
   }
 
-  if (vkCreateDevice(mPhysicalDevice, &createInfo, nullptr, &mDevice) !=
+  if (vkCreateDevice(mPhysicalDevice, &createInfo, mAllocator, &mDevice) !=
       VK_SUCCESS) {
     throw std::runtime_error("Failed to create logical device.");
   }
+  if (dynamicBlendEnable) {
+    mCmdSetColorBlendEnable =
+        (PFN_vkCmdSetColorBlendEnableEXT)vkGetDeviceProcAddr(
+            mDevice, "vkCmdSetColorBlendEnableEXT");
+  }
+
+  mMemoryTracker.init(mPhysicalDevice, mDevice, mMemoryBudgetSupported,
+                      mAllocator);
+  mBlockAllocator.init(&mMemoryTracker, MEMORY_BLOCK_SIZE);
+  mDefragmenter.init(&mBlockAllocator, DefragmentationBudget{});
+  mDeletionQueue.init(mDevice, mAllocator, mUseTimelineSemaphore);
+  mSubmitScheduler.init(mUseSynchronization2);
+  mPipelineCache.init(mPhysicalDevice, mDevice, mAllocator, "Chapter11");
+  if (!mDebugMode) {
+    mMemoryTracker.setLogInterval(std::chrono::seconds(0));
+  }
 }
 
 void App::createQueue() {
   QueueFamilyIndices indices = this->findQueueFamilies(mPhysicalDevice);
   vkGetDeviceQueue(mDevice, indices.graphicsFamily, 0, &mGraphicsQueue);
   vkGetDeviceQueue(mDevice, indices.presentFamily, 0, &mPresentQueue);
+  mPresentThread.init(mPresentQueue, mUsePresentThread);
+
+  mQueueFamilies = indices;
+  mUseTransferQueue = indices.transferFamily >= 0;
+  if (mUseTransferQueue) {
+    vkGetDeviceQueue(mDevice, indices.transferFamily, 0, &mTransferQueue);
+  }
+
+  mComputeFamily = indices.computeFamily >= 0 ? indices.computeFamily
+                                              : indices.graphicsFamily;
+  vkGetDeviceQueue(mDevice, mComputeFamily, 0, &mComputeQueue);
 }
 
 VkSurfaceFormatKHR
@@ -484,9 +579,10 @@ void App::createSwapchain() {
   createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
   createInfo.presentMode = presentMode;
   createInfo.clipped = VK_TRUE;
-  createInfo.oldSwapchain = VK_NULL_HANDLE;
+  // On recreation the old swapchain has been retired but not destroyed yet.
+  createInfo.oldSwapchain = mSwapchain;
 
-  if (vkCreateSwapchainKHR(mDevice, &createInfo, nullptr, &mSwapchain) !=
+  if (vkCreateSwapchainKHR(mDevice, &createInfo, mAllocator, &mSwapchain) !=
       VK_SUCCESS) {
     throw std::runtime_error("Failed to create swap chain.");
   }
@@ -519,7 +615,7 @@ VkImageView App::createImageView(VkImage image, VkFormat format,
   viewInfo.subresourceRange.layerCount = 1;
 
   VkImageView imageView;
-  if (vkCreateImageView(mDevice, &viewInfo, nullptr, &imageView) !=
+  if (vkCreateImageView(mDevice, &viewInfo, mAllocator, &imageView) !=
       VK_SUCCESS) {
     throw std::runtime_error("Failed to create texture image view.");
   }
@@ -537,14 +633,14 @@ void App::createImageViews() {
   }
 }
 
-VkShaderModule App::createShaderModule(vec<char> const &code) {
+VkShaderModule App::createShaderModule(ShaderCode const &code) {
   VkShaderModuleCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  createInfo.codeSize = code.size();
-  createInfo.pCode = reinterpret_cast<u32 const *>(code.data());
+  createInfo.codeSize = code.size;
+  createInfo.pCode = code.code;
 
   VkShaderModule shaderModule;
-  if (vkCreateShaderModule(mDevice, &createInfo, nullptr, &shaderModule) !=
+  if (vkCreateShaderModule(mDevice, &createInfo, mAllocator, &shaderModule) !=
       VK_SUCCESS) {
     throw std::runtime_error("Failed to create shader module.");
   }
@@ -584,6 +680,12 @@ bool App::hasStencilComponent(VkFormat format) {
 }
 
 void App::createRenderPass() {
+  mDepthFormat = this->findDepthFormat();
+  // The attachments are described at vkCmdBeginRendering instead.
+  if (mUseDynamicRendering) {
+    return;
+  }
+
   VkAttachmentDescription colorAttachment{};
   colorAttachment.format = mSwapchainImageFormat;
   colorAttachment.samples = mMSAASamples;
@@ -599,7 +701,7 @@ void App::createRenderPass() {
   colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
   VkAttachmentDescription depthAttachment{};
-  depthAttachment.format = this->findDepthFormat();
+  depthAttachment.format = mDepthFormat;
   depthAttachment.samples = mMSAASamples;
   depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -657,7 +759,7 @@ void App::createRenderPass() {
   renderPassInfo.dependencyCount = 1;
   renderPassInfo.pDependencies = &dependency;
 
-  if (vkCreateRenderPass(mDevice, &renderPassInfo, nullptr, &mRenderPass) !=
+  if (vkCreateRenderPass(mDevice, &renderPassInfo, mAllocator, &mRenderPass) !=
       VK_SUCCESS) {
     throw std::runtime_error("Failed to create RenderPass.");
   }
@@ -666,7 +768,7 @@ void App::createRenderPass() {
 void App::createDescriptorSetLayout() {
   VkDescriptorSetLayoutBinding uboLayoutBinding{};
   uboLayoutBinding.binding = 0;
-  uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   uboLayoutBinding.descriptorCount = 1;
   uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
   uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
@@ -686,35 +788,165 @@ void App::createDescriptorSetLayout() {
   layoutInfo.bindingCount = static_cast<u32>(bindings.size());
   layoutInfo.pBindings = bindings.data();
 
-  if (vkCreateDescriptorSetLayout(mDevice, &layoutInfo, nullptr,
+  if (vkCreateDescriptorSetLayout(mDevice, &layoutInfo, mAllocator,
                                   &mDescriptorSetLayout) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create descriptor set layout.");
   }
 }
 
 void App::createGraphicsPipeline() {
-  vec<char> vert = Util::readFile("assets/shaders/chapter11/shader.vert.spv");
-  vec<char> frag = Util::readFile("assets/shaders/chapter11/shader.frag.spv");
+  ShaderRegistry &shaders = ShaderRegistry::get();
+  ShaderCode vert =
+      shaders.find(mUsePushConstants ? "chapter11/shader_push.vert"
+                                     : "chapter11/shader.vert");
+  ShaderCode frag = shaders.find("chapter11/shader.frag");
 
-  VkShaderModule vertShaderModule = this->createShaderModule(vert);
-  VkShaderModule fragShaderModule = this->createShaderModule(frag);
+  mVertShaderModule = this->createShaderModule(vert);
+  mFragShaderModule = this->createShaderModule(frag);
 
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &mDescriptorSetLayout;
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(PushConstants);
+
+  if (mUsePushConstants) {
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+  } else {
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
+  }
+
+  if (vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, mAllocator,
+                             &mPipelineLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create pipeline layout.");
+  }
+
+  mPipelineManager.init(mDevice, mAllocator, PIPELINE_COMPILE_THREADS,
+                        this->getPipelineTarget(),
+                        [this](PipelineKey const &key,
+                               PipelineTarget const &target) {
+                          return this->buildGraphicsPipeline(key, target);
+                        });
+
+  mDefaultPipelineKey.samples = static_cast<u8>(mMSAASamples);
+  mDefaultPipelineKey.setFlag(PipelineKey::BLEND_BIT, true);
+  mDefaultPipelineKey.features = SHADER_FEATURE_TEXTURE;
+  mPipelineKey = mDefaultPipelineKey;
+  mGraphicsPipeline =
+      mPipelineManager.require(this->getCompiledKey(mDefaultPipelineKey));
+
+  // The permutations one key press away compile in the background, unless
+  // they are dynamic state of the default pipeline.
+  PipelineKey opaque = mDefaultPipelineKey;
+  opaque.setFlag(PipelineKey::BLEND_BIT, false);
+  mPipelineManager.prefetch(this->getCompiledKey(opaque));
+  PipelineKey twoSided = mDefaultPipelineKey;
+  twoSided.cullMode = VK_CULL_MODE_NONE;
+  mPipelineManager.prefetch(this->getCompiledKey(twoSided));
+}
+
+PipelineKey App::getCompiledKey(PipelineKey const &key) const {
+  if (!mUseExtendedDynamicState) {
+    return key;
+  }
+
+  // Dynamic state takes its default value, so keys that differ only there
+  // share one pipeline. Topology is dynamic only within its class.
+  PipelineKey defaults{};
+  PipelineKey compiled = key;
+  compiled.cullMode = defaults.cullMode;
+  compiled.frontFace = defaults.frontFace;
+  compiled.depthCompareOp = defaults.depthCompareOp;
+  compiled.setFlag(PipelineKey::DEPTH_TEST_BIT,
+                   defaults.hasFlag(PipelineKey::DEPTH_TEST_BIT));
+  compiled.setFlag(PipelineKey::DEPTH_WRITE_BIT,
+                   defaults.hasFlag(PipelineKey::DEPTH_WRITE_BIT));
+  if (mCmdSetColorBlendEnable != nullptr) {
+    compiled.setFlag(PipelineKey::BLEND_BIT,
+                     defaults.hasFlag(PipelineKey::BLEND_BIT));
+  }
+
+  switch (key.topology) {
+  case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+  case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+  case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+    compiled.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    break;
+
+  case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP:
+  case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN:
+  case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST_WITH_ADJACENCY:
+  case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP_WITH_ADJACENCY:
+    compiled.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    break;
+
+  default:
+    break;
+  }
+  return compiled;
+}
+
+PipelineTarget App::getPipelineTarget() const {
+  PipelineTarget target{};
+  target.renderPass = mRenderPass;
+  target.colorFormat = mSwapchainImageFormat;
+  target.depthFormat = mDepthFormat;
+  return target;
+}
+
+// Runs on the compile threads, so everything that may change after
+// initialization comes in through target.
+VkPipeline App::buildGraphicsPipeline(PipelineKey const &key,
+                                      PipelineTarget const &target) {
   VkPipelineShaderStageCreateInfo vertInfo{};
   vertInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   vertInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-  vertInfo.module = vertShaderModule;
+  vertInfo.module = mVertShaderModule;
   vertInfo.pName = "main";
 
   VkPipelineShaderStageCreateInfo fragInfo{};
   fragInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   fragInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  fragInfo.module = fragShaderModule;
+  fragInfo.module = mFragShaderModule;
   fragInfo.pName = "main";
 
+  array<VkBool32, SHADER_FEATURE_COUNT> features{};
+  array<VkSpecializationMapEntry, SHADER_FEATURE_COUNT> featureEntries{};
+  for (u32 i = 0; i < SHADER_FEATURE_COUNT; ++i) {
+    features[i] = (key.features >> i) & 1 ? VK_TRUE : VK_FALSE;
+    featureEntries[i].constantID = i;
+    featureEntries[i].offset = static_cast<u32>(i * sizeof(VkBool32));
+    featureEntries[i].size = sizeof(VkBool32);
+  }
+
+  VkSpecializationInfo specializationInfo{};
+  specializationInfo.mapEntryCount = SHADER_FEATURE_COUNT;
+  specializationInfo.pMapEntries = featureEntries.data();
+  specializationInfo.dataSize = sizeof(features);
+  specializationInfo.pData = features.data();
+  fragInfo.pSpecializationInfo = &specializationInfo;
+
   VkPipelineShaderStageCreateInfo stages[] = {vertInfo, fragInfo};
 
   vec<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
                                        VK_DYNAMIC_STATE_SCISSOR};
+  if (mUseExtendedDynamicState) {
+    dynamicStates.insert(dynamicStates.end(),
+                         {VK_DYNAMIC_STATE_CULL_MODE,
+                          VK_DYNAMIC_STATE_FRONT_FACE,
+                          VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY,
+                          VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+                          VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+                          VK_DYNAMIC_STATE_DEPTH_COMPARE_OP});
+  }
+  if (mCmdSetColorBlendEnable != nullptr) {
+    dynamicStates.push_back(VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT);
+  }
   VkPipelineDynamicStateCreateInfo dynamicState{};
   dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
   dynamicState.dynamicStateCount = static_cast<u32>(dynamicStates.size());
@@ -735,7 +967,7 @@ void App::createGraphicsPipeline() {
   VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
   inputAssembly.sType =
       VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  inputAssembly.topology = static_cast<VkPrimitiveTopology>(key.topology);
   inputAssembly.primitiveRestartEnable = VK_FALSE;
 
   VkPipelineViewportStateCreateInfo viewportState{};
@@ -749,8 +981,8 @@ void App::createGraphicsPipeline() {
   rasterizer.rasterizerDiscardEnable = VK_FALSE;
   rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
   rasterizer.lineWidth = 1.0f;
-  rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-  rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  rasterizer.cullMode = key.cullMode;
+  rasterizer.frontFace = static_cast<VkFrontFace>(key.frontFace);
   rasterizer.depthBiasEnable = VK_FALSE;
   rasterizer.depthBiasConstantFactor = 0.0f;
   rasterizer.depthBiasClamp = 0.0f;
@@ -760,7 +992,8 @@ void App::createGraphicsPipeline() {
   multisampling.sType =
       VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
   multisampling.sampleShadingEnable = VK_TRUE;
-  multisampling.rasterizationSamples = mMSAASamples;
+  multisampling.rasterizationSamples =
+      static_cast<VkSampleCountFlagBits>(key.samples);
   multisampling.minSampleShading = 0.2f;
   multisampling.pSampleMask = nullptr;
   multisampling.alphaToCoverageEnable = VK_FALSE;
@@ -770,7 +1003,7 @@ void App::createGraphicsPipeline() {
   colorBlendAttachment.colorWriteMask =
       VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
       VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-  colorBlendAttachment.blendEnable = VK_TRUE;
+  colorBlendAttachment.blendEnable = key.hasFlag(PipelineKey::BLEND_BIT);
   colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
   colorBlendAttachment.dstColorBlendFactor =
       VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
@@ -794,9 +1027,9 @@ void App::createGraphicsPipeline() {
   VkPipelineDepthStencilStateCreateInfo depthStencil{};
   depthStencil.sType =
       VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-  depthStencil.depthTestEnable = VK_TRUE;
-  depthStencil.depthWriteEnable = VK_TRUE;
-  depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+  depthStencil.depthTestEnable = key.hasFlag(PipelineKey::DEPTH_TEST_BIT);
+  depthStencil.depthWriteEnable = key.hasFlag(PipelineKey::DEPTH_WRITE_BIT);
+  depthStencil.depthCompareOp = static_cast<VkCompareOp>(key.depthCompareOp);
   depthStencil.depthBoundsTestEnable = VK_FALSE;
   depthStencil.minDepthBounds = 0.0f; // Optional
   depthStencil.maxDepthBounds = 1.0f; // Optional
@@ -804,18 +1037,6 @@ void App::createGraphicsPipeline() {
   depthStencil.front = {}; // Optional
   depthStencil.back = {};  // Optional
 
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 1;
-  pipelineLayoutInfo.pSetLayouts = &mDescriptorSetLayout;
-  pipelineLayoutInfo.pushConstantRangeCount = 0;
-  pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-  if (vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, nullptr,
-                             &mPipelineLayout) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to create pipeline layout.");
-  }
-
   VkGraphicsPipelineCreateInfo pipelineInfo{};
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineInfo.stageCount = 2;
@@ -829,18 +1050,80 @@ void App::createGraphicsPipeline() {
   pipelineInfo.pColorBlendState = &colorBlending;
   pipelineInfo.pDynamicState = &dynamicState;
   pipelineInfo.layout = mPipelineLayout;
-  pipelineInfo.renderPass = mRenderPass;
+  pipelineInfo.renderPass = target.renderPass;
   pipelineInfo.subpass = 0;
+
+  VkPipelineRenderingCreateInfo renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+  renderingInfo.colorAttachmentCount = 1;
+  renderingInfo.pColorAttachmentFormats = &target.colorFormat;
+  renderingInfo.depthAttachmentFormat = target.depthFormat;
+  if (mUseDynamicRendering) {
+    pipelineInfo.pNext = &renderingInfo;
+  }
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
   pipelineInfo.basePipelineIndex = -1;
 
-  if (vkCreateGraphicsPipelines(mDevice, nullptr, 1, &pipelineInfo, nullptr,
-                                &mGraphicsPipeline) != VK_SUCCESS) {
+  VkPipeline pipeline;
+  if (mPipelineCache.createGraphicsPipeline(pipelineInfo, mAllocator,
+                                            &pipeline) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create graphics pipeline.");
   }
+  return pipeline;
+}
+
+void App::createCullPipeline() {
+  VkDescriptorSetLayoutBinding binding{};
+  binding.binding = 0;
+  binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  binding.descriptorCount = 1;
+  binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 1;
+  layoutInfo.pBindings = &binding;
+
+  if (vkCreateDescriptorSetLayout(mDevice, &layoutInfo, mAllocator,
+                                  &mCullSetLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create cull descriptor set layout.");
+  }
+
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(CullConstants);
 
-  vkDestroyShaderModule(mDevice, fragShaderModule, nullptr);
-  vkDestroyShaderModule(mDevice, vertShaderModule, nullptr);
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &mCullSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  if (vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, mAllocator,
+                             &mCullPipelineLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create cull pipeline layout.");
+  }
+
+  ShaderCode comp = ShaderRegistry::get().find("chapter11/cull.comp");
+  VkShaderModule compShaderModule = this->createShaderModule(comp);
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = compShaderModule;
+  pipelineInfo.stage.pName = "main";
+  pipelineInfo.layout = mCullPipelineLayout;
+
+  if (mPipelineCache.createComputePipeline(pipelineInfo, mAllocator,
+                                           &mCullPipeline) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create cull pipeline.");
+  }
+
+  vkDestroyShaderModule(mDevice, compShaderModule, mAllocator);
 }
 
 void App::createColorResources() {
@@ -849,7 +1132,8 @@ void App::createColorResources() {
                     mMSAASamples, colorFormat, VK_IMAGE_TILING_OPTIMAL,
                     VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
                         VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mColorImage,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    MemoryCategory::ATTACHMENT, mColorImage,
                     mColorImageMemory);
   mColorImageView = this->createImageView(mColorImage, colorFormat,
                                           VK_IMAGE_ASPECT_COLOR_BIT, 1);
@@ -860,7 +1144,8 @@ void App::createDepthResources() {
   this->createImage(mSwapchainExtent.width, mSwapchainExtent.height, 1,
                     mMSAASamples, depthFormat, VK_IMAGE_TILING_OPTIMAL,
                     VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mDepthImage,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    MemoryCategory::ATTACHMENT, mDepthImage,
                     mDepthImageMemory);
   mDepthImageView = this->createImageView(mDepthImage, depthFormat,
                                           VK_IMAGE_ASPECT_DEPTH_BIT, 1);
@@ -870,6 +1155,10 @@ void App::createDepthResources() {
 }
 
 void App::createFramebuffers() {
+  if (mUseDynamicRendering) {
+    return;
+  }
+
   mSwapchainFramebuffers.resize(mSwapchainImageViews.size());
 
   for (u32 i = 0; i < mSwapchainImageViews.size(); ++i) {
@@ -887,7 +1176,7 @@ void App::createFramebuffers() {
     framebufferInfo.height = mSwapchainExtent.height;
     framebufferInfo.layers = 1;
 
-    if (vkCreateFramebuffer(mDevice, &framebufferInfo, nullptr,
+    if (vkCreateFramebuffer(mDevice, &framebufferInfo, mAllocator,
                             &mSwapchainFramebuffers[i]) != VK_SUCCESS) {
       throw std::runtime_error("Failed to create framebuffer.");
     }
@@ -895,22 +1184,10 @@ void App::createFramebuffers() {
 }
 
 u32 App::findMemoryType(u32 typeFilter, VkMemoryPropertyFlags properties) {
-  VkPhysicalDeviceMemoryProperties memProperties;
-  vkGetPhysicalDeviceMemoryProperties(mPhysicalDevice, &memProperties);
-
-  for (u32 i = 0; i < memProperties.memoryTypeCount; ++i) {
-    if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags &
-                                    properties) == properties) {
-      return i;
-    }
-  }
-
-  throw std::runtime_error("Failed to find suitable memory type.");
+  return Util::findMemoryType(mPhysicalDevice, typeFilter, properties);
 }
 
-void App::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                       VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                       VkDeviceMemory &bufferMemory) {
+VkBuffer App::createBufferObject(VkDeviceSize size, VkBufferUsageFlags usage) {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
@@ -918,10 +1195,20 @@ void App::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   bufferInfo.flags = 0; // Optional
 
-  if (vkCreateBuffer(mDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+  VkBuffer buffer;
+  if (vkCreateBuffer(mDevice, &bufferInfo, mAllocator, &buffer) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create vertex buffer.");
   }
 
+  return buffer;
+}
+
+void App::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                       VkMemoryPropertyFlags properties,
+                       MemoryCategory category, VkBuffer &buffer,
+                       VkDeviceMemory &bufferMemory) {
+  buffer = this->createBufferObject(size, usage);
+
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements(mDevice, buffer, &memRequirements);
 
@@ -931,7 +1218,7 @@ void App::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
   allocInfo.memoryTypeIndex =
       this->findMemoryType(memRequirements.memoryTypeBits, properties);
 
-  if (vkAllocateMemory(mDevice, &allocInfo, nullptr, &bufferMemory) !=
+  if (mMemoryTracker.allocate(allocInfo, category, &bufferMemory) !=
       VK_SUCCESS) {
     throw std::runtime_error("Failed to allocate vertex buffer memory.");
   }
@@ -939,56 +1226,52 @@ void App::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
   vkBindBufferMemory(mDevice, buffer, bufferMemory, 0);
 }
 
-VkCommandBuffer App::beginSingleTimeCommands() {
-  VkCommandBufferAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandPool = mCommandPool;
-  allocInfo.commandBufferCount = 1;
-
-  VkCommandBuffer commandBuffer;
-  vkAllocateCommandBuffers(mDevice, &allocInfo, &commandBuffer);
+void App::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                       VkMemoryPropertyFlags properties,
+                       MemoryCategory category, MovableResource resource,
+                       VkBuffer &buffer, MemoryAllocation &allocation) {
+  buffer = this->createBufferObject(size, usage);
 
-  VkCommandBufferBeginInfo beginInfo{};
-  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-  vkBeginCommandBuffer(commandBuffer, &beginInfo);
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(mDevice, buffer, &memRequirements);
+  allocation = mBlockAllocator.allocate(
+      memRequirements,
+      this->findMemoryType(memRequirements.memoryTypeBits, properties),
+      category, static_cast<u64>(resource));
 
-  return commandBuffer;
+  vkBindBufferMemory(mDevice, buffer, allocation.memory, allocation.offset);
 }
 
-void App::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-  vkEndCommandBuffer(commandBuffer);
-
-  VkSubmitInfo submitInfo{};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &commandBuffer;
+void App::createUploadBatch() {
+  UploadQueue graphics{mGraphicsQueue, mCommandPool,
+                       static_cast<u32>(mQueueFamilies.graphicsFamily)};
+  UploadQueue transfer{};
+  if (mUseTransferQueue) {
+    transfer = {mTransferQueue, mTransferCommandPool,
+                static_cast<u32>(mQueueFamilies.transferFamily)};
+  }
+  mUploadBatch.init(mDevice, mAllocator, &mDeletionQueue, &mSubmitScheduler,
+                    graphics, transfer);
+}
 
-  vkQueueSubmit(mGraphicsQueue, 1, &submitInfo,
-                VK_NULL_HANDLE); // TODO: change to use fence
-  vkQueueWaitIdle(mGraphicsQueue);
-  vkFreeCommandBuffers(mDevice, mCommandPool, 1, &commandBuffer);
+void App::retireStagingBuffer(VkBuffer buffer, VkDeviceMemory memory) {
+  mUploadBatch.retire([this, buffer, memory]() {
+    vkDestroyBuffer(mDevice, buffer, mAllocator);
+    mMemoryTracker.free(memory);
+  });
 }
 
 void App::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer,
                      VkDeviceSize size) {
-  VkCommandBuffer commandBuffer = this->beginSingleTimeCommands();
-
-  VkBufferCopy copyRegion{};
-  copyRegion.srcOffset = 0;
-  copyRegion.dstOffset = 0;
-  copyRegion.size = size;
-  vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-  this->endSingleTimeCommands(commandBuffer);
+  mUploadBatch.copyBuffer(
+      srcBuffer, dstBuffer, size,
+      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 }
 
-void App::createImage(u32 width, u32 height, u32 mipLevels,
-                      VkSampleCountFlagBits samples, VkFormat format,
-                      VkImageTiling tiling, VkImageUsageFlags usage,
-                      VkMemoryPropertyFlags properties, VkImage &image,
-                      VkDeviceMemory &imageMemory) {
+VkImage App::createImageObject(u32 width, u32 height, u32 mipLevels,
+                               VkSampleCountFlagBits samples, VkFormat format,
+                               VkImageTiling tiling, VkImageUsageFlags usage) {
   VkImageCreateInfo imageInfo{};
   imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1005,10 +1288,23 @@ void App::createImage(u32 width, u32 height, u32 mipLevels,
   imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   imageInfo.flags = 0; // Optional
 
-  if (vkCreateImage(mDevice, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+  VkImage image;
+  if (vkCreateImage(mDevice, &imageInfo, mAllocator, &image) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create image.");
   }
 
+  return image;
+}
+
+void App::createImage(u32 width, u32 height, u32 mipLevels,
+                      VkSampleCountFlagBits samples, VkFormat format,
+                      VkImageTiling tiling, VkImageUsageFlags usage,
+                      VkMemoryPropertyFlags properties,
+                      MemoryCategory category, VkImage &image,
+                      VkDeviceMemory &imageMemory) {
+  image = this->createImageObject(width, height, mipLevels, samples, format,
+                                  tiling, usage);
+
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(mDevice, image, &memRequirements);
   VkMemoryAllocateInfo allocInfo{};
@@ -1017,7 +1313,7 @@ void App::createImage(u32 width, u32 height, u32 mipLevels,
   allocInfo.memoryTypeIndex =
       this->findMemoryType(memRequirements.memoryTypeBits, properties);
 
-  if (vkAllocateMemory(mDevice, &allocInfo, nullptr, &imageMemory) !=
+  if (mMemoryTracker.allocate(allocInfo, category, &imageMemory) !=
       VK_SUCCESS) {
     throw std::runtime_error("Failed to allocate image memory.");
   }
@@ -1025,11 +1321,28 @@ void App::createImage(u32 width, u32 height, u32 mipLevels,
   vkBindImageMemory(mDevice, image, imageMemory, 0);
 }
 
+void App::createImage(u32 width, u32 height, u32 mipLevels,
+                      VkSampleCountFlagBits samples, VkFormat format,
+                      VkImageTiling tiling, VkImageUsageFlags usage,
+                      VkMemoryPropertyFlags properties,
+                      MemoryCategory category, MovableResource resource,
+                      VkImage &image, MemoryAllocation &allocation) {
+  image = this->createImageObject(width, height, mipLevels, samples, format,
+                                  tiling, usage);
+
+  VkMemoryRequirements memRequirements;
+  vkGetImageMemoryRequirements(mDevice, image, &memRequirements);
+  allocation = mBlockAllocator.allocate(
+      memRequirements,
+      this->findMemoryType(memRequirements.memoryTypeBits, properties),
+      category, static_cast<u64>(resource));
+
+  vkBindImageMemory(mDevice, image, allocation.memory, allocation.offset);
+}
+
 void App::transitionImageLayout(VkImage image, VkFormat format,
                                 VkImageLayout oldLayout,
                                 VkImageLayout newLayout, u32 mipLevels) {
-  VkCommandBuffer commandBuffer = this->beginSingleTimeCommands();
-
   VkImageMemoryBarrier barrier{};
   barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
   barrier.oldLayout = oldLayout;
@@ -1082,31 +1395,12 @@ void App::transitionImageLayout(VkImage image, VkFormat format,
     throw std::invalid_argument("Unsupported layout transition.");
   }
 
-  vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0,
-                       nullptr, 0, nullptr, 1, &barrier);
-
-  this->endSingleTimeCommands(commandBuffer);
+  mUploadBatch.transitionImage(barrier, sourceStage, destinationStage);
 }
 
 void App::copyBufferToImage(VkBuffer buffer, VkImage image, u32 width,
-                            u32 height) {
-  VkCommandBuffer commandBuffer = this->beginSingleTimeCommands();
-
-  VkBufferImageCopy region{};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = 1;
-  region.imageOffset = {0, 0, 0};
-  region.imageExtent = {width, height, 1};
-
-  vkCmdCopyBufferToImage(commandBuffer, buffer, image,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-  this->endSingleTimeCommands(commandBuffer);
+                            u32 height, u32 mipLevels) {
+  mUploadBatch.copyBufferToImage(buffer, image, {width, height}, mipLevels);
 }
 
 void App::generateMipmaps(VkImage image, VkFormat imageFormat, i32 texWidth,
@@ -1120,77 +1414,9 @@ void App::generateMipmaps(VkImage image, VkFormat imageFormat, i32 texWidth,
         "Texture image format does not support linear blitting.");
   }
 
-  VkCommandBuffer commandBuffer = this->beginSingleTimeCommands();
-
-  VkImageMemoryBarrier barrier{};
-  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  barrier.image = image;
-  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  barrier.subresourceRange.baseArrayLayer = 0;
-  barrier.subresourceRange.layerCount = 1;
-  barrier.subresourceRange.levelCount = 1;
-
-  i32 mipWidth = texWidth;
-  i32 mipHeight = texHeight;
-
-  for (u32 i = 1; i < mipLevels; ++i) {
-    barrier.subresourceRange.baseMipLevel = i - 1;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
-                         nullptr, 1, &barrier);
-
-    VkImageBlit blit{};
-    blit.srcOffsets[0] = {0, 0, 0};
-    blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
-    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    blit.srcSubresource.mipLevel = i - 1;
-    blit.srcSubresource.baseArrayLayer = 0;
-    blit.srcSubresource.layerCount = 1;
-    blit.dstOffsets[0] = {0, 0, 0};
-    blit.dstOffsets[1] = {mipWidth > 1 ? mipWidth / 2 : 1,
-                          mipHeight > 1 ? mipHeight / 2 : 1, 1};
-    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    blit.dstSubresource.mipLevel = i;
-    blit.dstSubresource.baseArrayLayer = 0;
-    blit.dstSubresource.layerCount = 1;
-
-    vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                   image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
-                   VK_FILTER_LINEAR);
-
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
-                         0, nullptr, 1, &barrier);
-
-    if (mipWidth > 1)
-      mipWidth /= 2;
-    if (mipHeight > 1)
-      mipHeight /= 2;
-  }
-
-  barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0,
-                       nullptr, 1, &barrier);
-
-  this->endSingleTimeCommands(commandBuffer);
+  mUploadBatch.generateMipmaps(
+      image, {static_cast<u32>(texWidth), static_cast<u32>(texHeight)},
+      mipLevels);
 }
 
 void App::createTexture() {
@@ -1198,7 +1424,7 @@ void App::createTexture() {
   stbi_uc *pixels =
       stbi_load(TEXTURE_PATH, &width, &height, &channels, STBI_rgb_alpha);
   VkDeviceSize imageSize = width * height * 4;
-  mMipLevels =
+  u32 mipLevels =
       static_cast<u32>(std::floor(std::log2(std::max(width, height)))) + 1;
 
   if (!pixels) {
@@ -1210,7 +1436,8 @@ void App::createTexture() {
   this->createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     stagingBuffer, stagingBufferMemory);
+                     MemoryCategory::STAGING, stagingBuffer,
+                     stagingBufferMemory);
 
   void *data;
   vkMapMemory(mDevice, stagingBufferMemory, 0, imageSize, 0, &data);
@@ -1218,27 +1445,37 @@ void App::createTexture() {
   vkUnmapMemory(mDevice, stagingBufferMemory);
   stbi_image_free(pixels);
 
+  VkImage textureImage;
+  MemoryAllocation textureAllocation;
   this->createImage(
-      width, height, mMipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB,
+      width, height, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB,
       VK_IMAGE_TILING_OPTIMAL,
       VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
           VK_IMAGE_USAGE_SAMPLED_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mTexture, mTextureMemory);
-  this->transitionImageLayout(mTexture, VK_FORMAT_R8G8B8A8_SRGB,
-                              VK_IMAGE_LAYOUT_UNDEFINED,
-                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mMipLevels);
-  this->copyBufferToImage(stagingBuffer, mTexture, static_cast<u32>(width),
-                          static_cast<u32>(height));
-  this->generateMipmaps(mTexture, VK_FORMAT_R8G8B8A8_SRGB, width, height,
-                        mMipLevels);
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::TEXTURE,
+      MovableResource::TEXTURE, textureImage, textureAllocation);
+  this->copyBufferToImage(stagingBuffer, textureImage, static_cast<u32>(width),
+                          static_cast<u32>(height), mipLevels);
+  this->generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, width, height,
+                        mipLevels);
+
+  this->retireStagingBuffer(stagingBuffer, stagingBufferMemory);
+
+  ImageHandle image = mImages.create(
+      textureImage, VK_NULL_HANDLE, textureAllocation,
+      {static_cast<u32>(width), static_cast<u32>(height)}, mipLevels);
+  mTexture = mTextures.create(image, VK_NULL_HANDLE);
 
-  vkDestroyBuffer(mDevice, stagingBuffer, nullptr);
-  vkFreeMemory(mDevice, stagingBufferMemory, nullptr);
+  if (mForceRelocation) {
+    this->padForRelocation(textureAllocation);
+  }
 }
 
 void App::createTextureImageView() {
-  mTextureImageView = this->createImageView(
-      mTexture, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mMipLevels);
+  ImageHandle image = mTextures.getImage(mTexture);
+  mImages.getView(image) = this->createImageView(
+      mImages.getImage(image), VK_FORMAT_R8G8B8A8_SRGB,
+      VK_IMAGE_ASPECT_COLOR_BIT, mImages.getMipLevels(image));
 }
 
 void App::createTextureSampler() {
@@ -1260,11 +1497,12 @@ void App::createTextureSampler() {
   samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
   samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
   samplerInfo.mipLodBias = 0.0f;
-  samplerInfo.maxLod = static_cast<float>(mMipLevels);
+  samplerInfo.maxLod =
+      static_cast<float>(mImages.getMipLevels(mTextures.getImage(mTexture)));
   samplerInfo.minLod = 0.0f;
 
-  if (vkCreateSampler(mDevice, &samplerInfo, nullptr, &mTextureSampler) !=
-      VK_SUCCESS) {
+  if (vkCreateSampler(mDevice, &samplerInfo, mAllocator,
+                      &mTextures.getSampler(mTexture)) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create texture sampler.");
   }
 }
@@ -1280,8 +1518,15 @@ void App::loadModel() {
     throw std::runtime_error(warn + err);
   }
 
+  size_t indexCount = 0;
+  for (auto const &shape : shapes) {
+    indexCount += shape.mesh.indices.size();
+  }
+  mIndices.reserve(indexCount);
+
   for (auto const &shape : shapes) {
     umap<Vertex, u32> uniqueVertices;
+    uniqueVertices.reserve(shape.mesh.indices.size());
     for (auto const &index : shape.mesh.indices) {
       Vertex vertex{};
 
@@ -1304,73 +1549,150 @@ void App::loadModel() {
       mIndices.push_back(uniqueVertices[vertex]);
     }
   }
-}
 
-void App::createVertexBuffer() {
-  VkDeviceSize bufferSize = mVertices.size() * sizeof(mVertices[0]);
+  using Real = tinyobj::real_t;
+  mModelParseBytes = (attrib.vertices.capacity() + attrib.normals.capacity() +
+                      attrib.texcoords.capacity() + attrib.colors.capacity()) *
+                     sizeof(Real);
+  for (auto const &shape : shapes) {
+    mModelParseBytes +=
+        shape.mesh.indices.capacity() * sizeof(tinyobj::index_t) +
+        shape.mesh.num_face_vertices.capacity() * sizeof(unsigned int) +
+        shape.mesh.material_ids.capacity() * sizeof(int);
+  }
+}
 
+BufferHandle App::createGeometryBuffer(void const *data, VkDeviceSize size,
+                                       VkBufferUsageFlags usage,
+                                       MovableResource resource) {
   VkBuffer stagingBuffer;
   VkDeviceMemory stagingBufferMemory;
-  this->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+  this->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     stagingBuffer, stagingBufferMemory);
+                     MemoryCategory::STAGING, stagingBuffer,
+                     stagingBufferMemory);
 
-  void *data;
-  vkMapMemory(mDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-  std::memcpy(data, mVertices.data(), (size_t)bufferSize);
+  void *mapped;
+  vkMapMemory(mDevice, stagingBufferMemory, 0, size, 0, &mapped);
+  std::memcpy(mapped, data, (size_t)size);
   vkUnmapMemory(mDevice, stagingBufferMemory);
 
-  this->createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mVertexBuffer, mVertexBufferMemory);
-  this->copyBuffer(stagingBuffer, mVertexBuffer, bufferSize);
+  VkBuffer buffer;
+  MemoryAllocation allocation;
+  this->createBuffer(size,
+                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                         VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                     MemoryCategory::GEOMETRY, resource, buffer, allocation);
+  this->copyBuffer(stagingBuffer, buffer, size);
 
-  vkDestroyBuffer(mDevice, stagingBuffer, nullptr);
-  vkFreeMemory(mDevice, stagingBufferMemory, nullptr);
+  this->retireStagingBuffer(stagingBuffer, stagingBufferMemory);
+  return mBuffers.create(buffer, allocation, size);
 }
 
-void App::createIndexBuffer() {
-  VkDeviceSize bufferSize = sizeof(mIndices[0]) * mIndices.size();
+void App::createMesh() {
+  BufferHandle vertexBuffer = this->createGeometryBuffer(
+      mVertices.data(), sizeof(mVertices[0]) * mVertices.size(),
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MovableResource::VERTEX_BUFFER);
+  BufferHandle indexBuffer = this->createGeometryBuffer(
+      mIndices.data(), sizeof(mIndices[0]) * mIndices.size(),
+      VK_BUFFER_USAGE_INDEX_BUFFER_BIT, MovableResource::INDEX_BUFFER);
+  if (mForceRelocation) {
+    this->padForRelocation(mBuffers.getAllocation(vertexBuffer));
+  }
 
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  this->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     stagingBuffer, stagingBufferMemory);
+  // A sphere around the center of the bounding box: looser than a minimal
+  // sphere but cheap, and culling only needs it to be conservative.
+  glm::vec3 lower(std::numeric_limits<float>::max());
+  glm::vec3 upper(std::numeric_limits<float>::lowest());
+  for (auto const &vertex : mVertices) {
+    lower = glm::min(lower, vertex.pos);
+    upper = glm::max(upper, vertex.pos);
+  }
+  glm::vec3 center = (lower + upper) * 0.5f;
+  float radius = 0.0f;
+  for (auto const &vertex : mVertices) {
+    radius = std::max(radius, glm::distance(center, vertex.pos));
+  }
 
-  void *data;
-  vkMapMemory(mDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-  std::memcpy(data, mIndices.data(), (size_t)bufferSize);
-  vkUnmapMemory(mDevice, stagingBufferMemory);
+  mMesh = mMeshes.create(vertexBuffer, indexBuffer,
+                         static_cast<u32>(mIndices.size()),
+                         glm::vec4(center, radius));
+}
 
-  this->createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mIndexBuffer, mIndexBufferMemory);
-  this->copyBuffer(stagingBuffer, mIndexBuffer, bufferSize);
+void App::releaseGeometryCopies() {
+  if (mKeepGeometryCopies) {
+    return;
+  }
 
-  vkDestroyBuffer(mDevice, stagingBuffer, nullptr);
-  vkFreeMemory(mDevice, stagingBufferMemory, nullptr);
+  // clear() keeps the capacity, so swap with empty vectors to give the
+  // memory back.
+  vec<Vertex>().swap(mVertices);
+  vec<u32>().swap(mIndices);
 }
 
 void App::createUniformBuffers() {
-  VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+  mUniformRing.init(mPhysicalDevice, mDevice, &mMemoryTracker,
+                    UNIFORM_RING_FRAME_SIZE, mFramesInFlight);
+}
+
+void App::createCullBuffer() {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(mPhysicalDevice, &properties);
+  VkDeviceSize alignment = std::max<VkDeviceSize>(
+      properties.limits.minStorageBufferOffsetAlignment, 1);
+  mCullFrameSize = (sizeof(CullDraw) * CULL_DRAW_CAPACITY + alignment - 1) /
+                   alignment * alignment;
+
+  // Written by compute and read by graphics every frame, so a dedicated
+  // compute family shares the buffer instead of transferring ownership.
+  u32 families[] = {static_cast<u32>(mQueueFamilies.graphicsFamily),
+                    mComputeFamily};
+  bool shared = families[0] != families[1];
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = mCullFrameSize * mFramesInFlight;
+  bufferInfo.usage =
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+  if (shared) {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = 2;
+    bufferInfo.pQueueFamilyIndices = families;
+  } else {
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  }
 
-  mUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-  mUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-  mUniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+  if (vkCreateBuffer(mDevice, &bufferInfo, mAllocator, &mCullBuffer) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create cull buffer.");
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(mDevice, mCullBuffer, &memRequirements);
 
-  for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-    this->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                       mUniformBuffers[i], mUniformBuffersMemory[i]);
-    vkMapMemory(mDevice, mUniformBuffersMemory[i], 0, bufferSize, 0,
-                &mUniformBuffersMapped[i]);
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = memRequirements.size;
+  allocInfo.memoryTypeIndex =
+      this->findMemoryType(memRequirements.memoryTypeBits,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  // Rewritten by the host every frame, like the uniform ring.
+  if (mMemoryTracker.allocate(allocInfo, MemoryCategory::UNIFORM,
+                              &mCullMemory) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate cull buffer memory.");
   }
+
+  vkBindBufferMemory(mDevice, mCullBuffer, mCullMemory, 0);
+  vkMapMemory(mDevice, mCullMemory, 0, bufferInfo.size, 0,
+              reinterpret_cast<void **>(&mCullMapped));
+}
+
+VkDeviceSize App::getCullCommandOffset(u32 frame, u32 draw) const {
+  return frame * mCullFrameSize + draw * sizeof(CullDraw) +
+         offsetof(CullDraw, command);
 }
 
 void App::createCommandPool() {
@@ -1379,107 +1701,499 @@ void App::createCommandPool() {
 
   VkCommandPoolCreateInfo poolInfo{};
   poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
   poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
 
-  if (vkCreateCommandPool(mDevice, &poolInfo, nullptr, &mCommandPool) !=
+  if (vkCreateCommandPool(mDevice, &poolInfo, mAllocator, &mCommandPool) !=
       VK_SUCCESS) {
     throw std::runtime_error("Failed to create command pool.");
   }
+
+  if (mUseTransferQueue) {
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
+    if (vkCreateCommandPool(mDevice, &poolInfo, mAllocator,
+                            &mTransferCommandPool) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create transfer command pool.");
+    }
+  }
+
+  this->createUploadBatch();
 }
 
 void App::createDescriptorPool() {
   vec<VkDescriptorPoolSize> poolSizes;
-  poolSizes.resize(2);
+  poolSizes.resize(3);
 
-  poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  poolSizes[0].descriptorCount = static_cast<u32>(MAX_FRAMES_IN_FLIGHT);
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  poolSizes[0].descriptorCount = mFramesInFlight;
   poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  poolSizes[1].descriptorCount = static_cast<u32>(MAX_FRAMES_IN_FLIGHT);
+  poolSizes[1].descriptorCount = mFramesInFlight;
+  poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[2].descriptorCount = mFramesInFlight;
 
   VkDescriptorPoolCreateInfo poolInfo{};
   poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
   poolInfo.poolSizeCount = static_cast<u32>(poolSizes.size());
   poolInfo.pPoolSizes = poolSizes.data();
-  poolInfo.maxSets = static_cast<u32>(MAX_FRAMES_IN_FLIGHT);
+  poolInfo.maxSets = mFramesInFlight * 2;
 
-  if (vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &mDescriptorPool) !=
-      VK_SUCCESS) {
+  if (vkCreateDescriptorPool(mDevice, &poolInfo, mAllocator,
+                             &mDescriptorPool) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create descriptor pool.");
   }
 }
 
+void App::updateDescriptorSet(u32 index) {
+  VkDescriptorBufferInfo bufferInfo{};
+  bufferInfo.buffer = mUniformRing.getBuffer();
+  bufferInfo.offset = 0;
+  bufferInfo.range = sizeof(UniformBufferObject);
+
+  VkDescriptorImageInfo imageInfo{};
+  imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  imageInfo.imageView = mImages.getView(mTextures.getImage(mTexture));
+  imageInfo.sampler = mTextures.getSampler(mTexture);
+
+  vec<VkWriteDescriptorSet> descriptorWrites;
+  descriptorWrites.resize(2);
+
+  descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptorWrites[0].dstSet = mDescriptorSets[index];
+  descriptorWrites[0].dstBinding = 0;
+  descriptorWrites[0].dstArrayElement = 0;
+  descriptorWrites[0].descriptorType =
+      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  descriptorWrites[0].descriptorCount = 1;
+  descriptorWrites[0].pBufferInfo = &bufferInfo;
+  descriptorWrites[0].pImageInfo = nullptr;       // Optional
+  descriptorWrites[0].pTexelBufferView = nullptr; // Optional
+
+  descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptorWrites[1].dstSet = mDescriptorSets[index];
+  descriptorWrites[1].dstBinding = 1;
+  descriptorWrites[1].dstArrayElement = 0;
+  descriptorWrites[1].descriptorType =
+      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  descriptorWrites[1].descriptorCount = 1;
+  descriptorWrites[1].pBufferInfo = nullptr; // Optional
+  descriptorWrites[1].pImageInfo = &imageInfo;
+  descriptorWrites[1].pTexelBufferView = nullptr; // Optional
+
+  vkUpdateDescriptorSets(mDevice, static_cast<u32>(descriptorWrites.size()),
+                         descriptorWrites.data(), 0, nullptr);
+}
+
 void App::createDescriptorSets() {
-  vec<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT,
+  vec<VkDescriptorSetLayout> layouts(mFramesInFlight,
                                      mDescriptorSetLayout);
   VkDescriptorSetAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
   allocInfo.descriptorPool = mDescriptorPool;
-  allocInfo.descriptorSetCount = static_cast<u32>(MAX_FRAMES_IN_FLIGHT);
+  allocInfo.descriptorSetCount = mFramesInFlight;
   allocInfo.pSetLayouts = layouts.data();
 
-  mDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+  mDescriptorSets.resize(mFramesInFlight);
   if (vkAllocateDescriptorSets(mDevice, &allocInfo, mDescriptorSets.data()) !=
       VK_SUCCESS) {
     throw std::runtime_error("Failed to allocate descriptor sets.");
   }
 
-  for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+  mDescriptorSetsDirty.assign(mFramesInFlight, false);
+  for (u32 i = 0; i < mFramesInFlight; ++i) {
+    this->updateDescriptorSet(i);
+  }
+
+  vec<VkDescriptorSetLayout> cullLayouts(mFramesInFlight, mCullSetLayout);
+  allocInfo.pSetLayouts = cullLayouts.data();
+
+  mCullDescriptorSets.resize(mFramesInFlight);
+  if (vkAllocateDescriptorSets(mDevice, &allocInfo,
+                               mCullDescriptorSets.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate cull descriptor sets.");
+  }
+
+  for (u32 i = 0; i < mFramesInFlight; ++i) {
     VkDescriptorBufferInfo bufferInfo{};
-    bufferInfo.buffer = mUniformBuffers[i];
-    bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(UniformBufferObject);
-
-    VkDescriptorImageInfo imageInfo{};
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = mTextureImageView;
-    imageInfo.sampler = mTextureSampler;
-
-    vec<VkWriteDescriptorSet> descriptorWrites;
-    descriptorWrites.resize(2);
-
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = mDescriptorSets[i];
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pBufferInfo = &bufferInfo;
-    descriptorWrites[0].pImageInfo = nullptr;       // Optional
-    descriptorWrites[0].pTexelBufferView = nullptr; // Optional
-
-    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet = mDescriptorSets[i];
-    descriptorWrites[1].dstBinding = 1;
-    descriptorWrites[1].dstArrayElement = 0;
-    descriptorWrites[1].descriptorType =
-        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[1].descriptorCount = 1;
-    descriptorWrites[1].pBufferInfo = nullptr; // Optional
-    descriptorWrites[1].pImageInfo = &imageInfo;
-    descriptorWrites[1].pTexelBufferView = nullptr; // Optional
-
-    vkUpdateDescriptorSets(mDevice, static_cast<u32>(descriptorWrites.size()),
-                           descriptorWrites.data(), 0, nullptr);
+    bufferInfo.buffer = mCullBuffer;
+    bufferInfo.offset = i * mCullFrameSize;
+    bufferInfo.range = mCullFrameSize;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = mCullDescriptorSets[i];
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(mDevice, 1, &descriptorWrite, 0, nullptr);
+  }
+}
+
+void App::recordBufferRelocation(VkCommandBuffer commandBuffer, VkBuffer src,
+                                 VkBuffer dst, VkDeviceSize size) {
+  VkBufferCopy copyRegion{};
+  copyRegion.srcOffset = 0;
+  copyRegion.dstOffset = 0;
+  copyRegion.size = size;
+  vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copyRegion);
+
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask =
+      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = dst;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1,
+                       &barrier, 0, nullptr);
+}
+
+void App::recordImageRelocation(VkCommandBuffer commandBuffer,
+                                ImageHandle src, VkImage dst) {
+  u32 mipLevels = mImages.getMipLevels(src);
+  VkExtent2D extent = mImages.getExtent(src);
+
+  array<VkImageMemoryBarrier, 2> barriers{};
+  for (auto &barrier : barriers) {
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+  }
+
+  barriers[0].image = mImages.getImage(src);
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  barriers[1].image = dst;
+  barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[1].srcAccessMask = 0;
+  barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, static_cast<u32>(barriers.size()),
+                       barriers.data());
+
+  vec<VkImageCopy> regions(mipLevels);
+  for (u32 i = 0; i < mipLevels; ++i) {
+    regions[i].srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    regions[i].srcSubresource.mipLevel = i;
+    regions[i].srcSubresource.baseArrayLayer = 0;
+    regions[i].srcSubresource.layerCount = 1;
+    regions[i].srcOffset = {0, 0, 0};
+    regions[i].dstSubresource = regions[i].srcSubresource;
+    regions[i].dstOffset = {0, 0, 0};
+    regions[i].extent = {std::max(extent.width >> i, 1u),
+                         std::max(extent.height >> i, 1u), 1};
+  }
+  vkCmdCopyImage(commandBuffer, mImages.getImage(src),
+                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst,
+                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 static_cast<u32>(regions.size()), regions.data());
+
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0,
+                       nullptr, static_cast<u32>(barriers.size()),
+                       barriers.data());
+}
+
+void App::padForRelocation(MemoryAllocation const &allocation) {
+  // Half a block elsewhere is denser than the block holding the allocation,
+  // so the next pass empties that block into the padding's block.
+  for (auto const &stats : mBlockAllocator.getBlockStats()) {
+    if (stats.id != allocation.blockId) {
+      continue;
+    }
+    if (stats.used * 2 >= stats.size) {
+      std::cerr << "WARNING: Memory block " << stats.id
+                << " is too full to force a relocation." << std::endl;
+      return;
+    }
+
+    VkMemoryRequirements requirements{};
+    requirements.size = stats.size / 2;
+    requirements.alignment = 1;
+    requirements.memoryTypeBits = 1u << stats.memoryTypeIndex;
+    mRelocationPadding.push_back(mBlockAllocator.allocate(
+        requirements, stats.memoryTypeIndex, stats.category,
+        static_cast<u64>(MovableResource::PADDING), {stats.id}));
+    return;
+  }
+}
+
+BufferHandle App::getMovableBuffer(MovableResource resource) const {
+  return resource == MovableResource::VERTEX_BUFFER
+             ? mMeshes.getVertexBuffer(mMesh)
+             : mMeshes.getIndexBuffer(mMesh);
+}
+
+bool App::relocateResource(VkCommandBuffer commandBuffer, u64 userData,
+                           MemoryAllocation const &allocation,
+                           vec<u32> const &sourceBlocks) {
+  Relocation relocation{};
+  relocation.resource = static_cast<MovableResource>(userData);
+  relocation.frame = mFrameCount;
+  if (relocation.resource == MovableResource::PADDING) {
+    return false;
+  }
+
+  for (auto const &pending : mPendingRelocations) {
+    if (pending.resource == relocation.resource) {
+      return false;
+    }
+  }
+
+  VkMemoryRequirements memRequirements;
+  MemoryCategory category;
+  if (relocation.resource == MovableResource::TEXTURE) {
+    ImageHandle image = mTextures.getImage(mTexture);
+    if (!(mImages.getAllocation(image) == allocation)) {
+      return false;
+    }
+
+    VkExtent2D extent = mImages.getExtent(image);
+    relocation.image = this->createImageObject(
+        extent.width, extent.height, mImages.getMipLevels(image),
+        VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+            VK_IMAGE_USAGE_SAMPLED_BIT);
+    vkGetImageMemoryRequirements(mDevice, relocation.image, &memRequirements);
+    category = MemoryCategory::TEXTURE;
+  } else {
+    BufferHandle buffer = this->getMovableBuffer(relocation.resource);
+    if (!(mBuffers.getAllocation(buffer) == allocation)) {
+      return false;
+    }
+
+    bool isVertex = relocation.resource == MovableResource::VERTEX_BUFFER;
+    relocation.buffer = this->createBufferObject(
+        mBuffers.getSize(buffer),
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+            (isVertex ? VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+                      : VK_BUFFER_USAGE_INDEX_BUFFER_BIT));
+    vkGetBufferMemoryRequirements(mDevice, relocation.buffer,
+                                  &memRequirements);
+    category = MemoryCategory::GEOMETRY;
+  }
+
+  // Only move into blocks that already exist, otherwise compaction would just
+  // create new sparse blocks.
+  relocation.allocation = mBlockAllocator.allocate(
+      memRequirements,
+      this->findMemoryType(memRequirements.memoryTypeBits,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+      category, userData, sourceBlocks, false);
+  if (!relocation.allocation.isValid()) {
+    this->destroyRelocation(relocation);
+    return false;
+  }
+
+  if (relocation.image != VK_NULL_HANDLE) {
+    ImageHandle image = mTextures.getImage(mTexture);
+    vkBindImageMemory(mDevice, relocation.image, relocation.allocation.memory,
+                      relocation.allocation.offset);
+    relocation.view = this->createImageView(
+        relocation.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT,
+        mImages.getMipLevels(image));
+    this->recordImageRelocation(commandBuffer, image, relocation.image);
+  } else {
+    BufferHandle buffer = this->getMovableBuffer(relocation.resource);
+    vkBindBufferMemory(mDevice, relocation.buffer,
+                       relocation.allocation.memory,
+                       relocation.allocation.offset);
+    this->recordBufferRelocation(commandBuffer, mBuffers.getBuffer(buffer),
+                                 relocation.buffer, mBuffers.getSize(buffer));
+  }
+
+  mPendingRelocations.push_back(relocation);
+  return true;
+}
+
+void App::destroyRelocation(Relocation const &relocation) {
+  if (relocation.view != VK_NULL_HANDLE) {
+    vkDestroyImageView(mDevice, relocation.view, mAllocator);
+  }
+  if (relocation.image != VK_NULL_HANDLE) {
+    vkDestroyImage(mDevice, relocation.image, mAllocator);
+  }
+  if (relocation.buffer != VK_NULL_HANDLE) {
+    vkDestroyBuffer(mDevice, relocation.buffer, mAllocator);
   }
+  mBlockAllocator.free(relocation.allocation);
+}
+
+void App::updateRelocations() {
+  // Called right after waiting on this frame's fence, so every frame up to
+  // mFrameCount - mFramesInFlight has finished on the GPU.
+  auto isComplete = [this](u64 frame) {
+    return frame + mFramesInFlight <= mFrameCount;
+  };
+
+  std::erase_if(mPendingRelocations, [&](Relocation const &pending) {
+    if (!isComplete(pending.frame)) {
+      return false;
+    }
+
+    Relocation retired = pending;
+    switch (pending.resource) {
+    case MovableResource::VERTEX_BUFFER:
+    case MovableResource::INDEX_BUFFER: {
+      BufferHandle buffer = this->getMovableBuffer(pending.resource);
+      std::swap(retired.buffer, mBuffers.getBuffer(buffer));
+      std::swap(retired.allocation, mBuffers.getAllocation(buffer));
+      break;
+    }
+    case MovableResource::TEXTURE: {
+      ImageHandle image = mTextures.getImage(mTexture);
+      std::swap(retired.image, mImages.getImage(image));
+      std::swap(retired.view, mImages.getView(image));
+      std::swap(retired.allocation, mImages.getAllocation(image));
+      mDescriptorSetsDirty.assign(mFramesInFlight, true);
+      break;
+    }
+    case MovableResource::PADDING:
+      break;
+    }
+    // Cached recordings still bind the old buffers and descriptor sets.
+    mCommandCache.invalidate();
+
+    // Frames already submitted still read the old copy.
+    mDeletionQueue.retire(
+        mDeletionQueue.getLastSubmission(),
+        [this, retired]() { this->destroyRelocation(retired); });
+    return true;
+  });
+
+  // Descriptor sets can only be patched once the frame using them is done.
+  if (mDescriptorSetsDirty[mCurrentFrame]) {
+    this->updateDescriptorSet(mCurrentFrame);
+    mDescriptorSetsDirty[mCurrentFrame] = false;
+  }
+
+  if (mFrameCount % DEFRAGMENTATION_INTERVAL == 0) {
+    mDefragmenter.beginPass();
+  }
+}
+
+MemoryReport App::createMemoryReport() const {
+  MemoryReport report;
+  report.capture();
+
+  // Host memory only; device memory, mapped or not, is logged by the
+  // memory tracker.
+  report.set("geometry copies", mVertices.capacity() * sizeof(Vertex) +
+                                    mIndices.capacity() * sizeof(u32));
+  report.setPeak("model parsing", mModelParseBytes);
+
+  HostAllocator const &hostAllocator = HostAllocator::get();
+  report.set("driver host allocations",
+             hostAllocator.getTotalBytes() + hostAllocator.getInternalBytes());
+  return report;
+}
+
+void App::destroyResources() {
+  mTextures.forEach([this](TextureHandle, ImageHandle, VkSampler sampler) {
+    vkDestroySampler(mDevice, sampler, mAllocator);
+  });
+  mTextures.clear();
+  mMeshes.clear();
+
+  mImages.forEach([this](ImageHandle, VkImage image, VkImageView view,
+                         MemoryAllocation const &allocation, VkExtent2D, u32) {
+    vkDestroyImageView(mDevice, view, mAllocator);
+    vkDestroyImage(mDevice, image, mAllocator);
+    mBlockAllocator.free(allocation);
+  });
+  mImages.clear();
+
+  mBuffers.forEach([this](BufferHandle, VkBuffer buffer,
+                          MemoryAllocation const &allocation, VkDeviceSize) {
+    vkDestroyBuffer(mDevice, buffer, mAllocator);
+    mBlockAllocator.free(allocation);
+  });
+  mBuffers.clear();
+
+  for (auto const &padding : mRelocationPadding) {
+    mBlockAllocator.free(padding);
+  }
+  mRelocationPadding.clear();
 }
 
 void App::createCommandBuffers() {
-  mCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+  u32 workerCount = std::clamp(std::thread::hardware_concurrency(), 1u,
+                               RECORDING_THREAD_LIMIT);
+  mRecordingWorkers.init(workerCount);
+  mFrameCommandPools.init(mDevice, mAllocator, mQueueFamilies.graphicsFamily,
+                          mFramesInFlight, workerCount + 1);
+
+  mAsyncCompute.init(mPhysicalDevice, mDevice, mAllocator, &mSubmitScheduler,
+                     mComputeQueue, mComputeFamily,
+                     mQueueFamilies.graphicsFamily, mFramesInFlight);
+  if (!mDebugMode) {
+    mAsyncCompute.setLogInterval(std::chrono::seconds(0));
+  }
 
-  VkCommandBufferAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocInfo.commandPool = mCommandPool;
-  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandBufferCount = (u32)mCommandBuffers.size();
+  if (mCacheCommandBuffers && mUsePushConstants) {
+    std::cerr << "WARNING: Command buffer caching needs the uniform path, "
+                 "recording every frame instead."
+              << std::endl;
+    mCacheCommandBuffers = false;
+  }
+  if (mCacheCommandBuffers) {
+    mCommandCache.init(mDevice, mAllocator, mQueueFamilies.graphicsFamily,
+                       mFramesInFlight);
+    mCommandCache.resize(static_cast<u32>(mSwapchainImages.size()));
+  }
+}
 
-  if (vkAllocateCommandBuffers(mDevice, &allocInfo, mCommandBuffers.data()) !=
-      VK_SUCCESS) {
-    throw std::runtime_error("Failed to allocate command buffers.");
+void App::recordRelocationPass(VkCommandBuffer commandBuffer) {
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to begin recording.");
+  }
+
+  mDefragmenter.step([&](u64 userData, MemoryAllocation const &allocation,
+                         vec<u32> const &sourceBlocks) {
+    return this->relocateResource(commandBuffer, userData, allocation,
+                                  sourceBlocks);
+  });
+
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to record relocation pass.");
   }
 }
 
-void App::recordCommandBuffer(VkCommandBuffer commandBuffer, u32 imageIndex) {
+void App::recordCommandBuffer(VkCommandBuffer commandBuffer, u32 imageIndex,
+                              FrameSnapshot const &snapshot, bool cached) {
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   beginInfo.flags = 0;                  // Optional
@@ -1488,24 +2202,166 @@ void App::recordCommandBuffer(VkCommandBuffer commandBuffer, u32 imageIndex) {
   if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
     throw std::runtime_error("Failed to begin recording.");
   }
+  mAsyncCompute.beginGraphics(commandBuffer, mCurrentFrame);
+
+  // A cached buffer is replayed on later frames, so it leaves out the one-off
+  // relocation copies and the secondary buffers of the current frame.
+  if (!cached) {
+    mDefragmenter.step([&](u64 userData, MemoryAllocation const &allocation,
+                           vec<u32> const &sourceBlocks) {
+      return this->relocateResource(commandBuffer, userData, allocation,
+                                    sourceBlocks);
+    });
+  }
+
+  u32 drawCount = static_cast<u32>(snapshot.draws.size());
+  u32 taskCount = cached ? 0 : this->getRecordingTaskCount(drawCount);
+  this->beginRendering(commandBuffer, imageIndex, taskCount > 0);
+  if (taskCount == 0) {
+    this->recordDraws(commandBuffer, snapshot, 0, drawCount);
+  } else {
+    array<VkCommandBuffer, RECORDING_THREAD_LIMIT> secondaries{};
+    mRecordingWorkers.run(taskCount, [&](u32 task) {
+      secondaries[task] =
+          this->recordSecondaryDraws(task, taskCount, imageIndex, snapshot);
+    });
+    vkCmdExecuteCommands(commandBuffer, taskCount, secondaries.data());
+  }
+  this->endRendering(commandBuffer, imageIndex);
+
+  mAsyncCompute.endGraphics(commandBuffer, mCurrentFrame);
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to record command buffer.");
+  }
+}
+
+void App::beginRendering(VkCommandBuffer commandBuffer, u32 imageIndex,
+                         bool secondaries) {
+  VkClearValue colorClear{};
+  colorClear.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+  VkClearValue depthClear{};
+  depthClear.depthStencil = {1.0f, 0};
+
+  if (!mUseDynamicRendering) {
+    array<VkClearValue, 2> clearValues = {colorClear, depthClear};
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = mRenderPass;
+    renderPassInfo.framebuffer = mSwapchainFramebuffers[imageIndex];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = mSwapchainExtent;
+    renderPassInfo.clearValueCount = static_cast<u32>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                         secondaries
+                             ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                             : VK_SUBPASS_CONTENTS_INLINE);
+    return;
+  }
+
+  // The layout transitions the render pass did on load. Every attachment is
+  // cleared or resolved into, so the old contents are discarded.
+  array<VkImageMemoryBarrier, 3> barriers{};
+  for (auto &barrier : barriers) {
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+  }
+  // The MSAA targets are shared by every frame in flight, so the previous
+  // frame's writes must land before this frame clears them.
+  barriers[0].image = mColorImage;
+  barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barriers[1].image = mSwapchainImages[imageIndex];
+  barriers[2].image = mDepthImage;
+  barriers[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  barriers[2].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  barriers[2].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  barriers[2].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  if (this->hasStencilComponent(mDepthFormat)) {
+    barriers[2].subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+  }
+
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                           VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                           VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                       0, 0, nullptr, 0, nullptr,
+                       static_cast<u32>(barriers.size()), barriers.data());
+
+  VkRenderingAttachmentInfo colorAttachment{};
+  colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+  colorAttachment.imageView = mColorImageView;
+  colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+  colorAttachment.resolveImageView = mSwapchainImageViews[imageIndex];
+  colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  colorAttachment.clearValue = colorClear;
+
+  VkRenderingAttachmentInfo depthAttachment{};
+  depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+  depthAttachment.imageView = mDepthImageView;
+  depthAttachment.imageLayout =
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.clearValue = depthClear;
+
+  VkRenderingInfo renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+  renderingInfo.flags =
+      secondaries ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+  renderingInfo.renderArea.offset = {0, 0};
+  renderingInfo.renderArea.extent = mSwapchainExtent;
+  renderingInfo.layerCount = 1;
+  renderingInfo.colorAttachmentCount = 1;
+  renderingInfo.pColorAttachments = &colorAttachment;
+  renderingInfo.pDepthAttachment = &depthAttachment;
+
+  vkCmdBeginRendering(commandBuffer, &renderingInfo);
+}
+
+void App::endRendering(VkCommandBuffer commandBuffer, u32 imageIndex) {
+  if (!mUseDynamicRendering) {
+    vkCmdEndRenderPass(commandBuffer);
+    return;
+  }
 
-  VkRenderPassBeginInfo renderPassInfo{};
-  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  renderPassInfo.renderPass = mRenderPass;
-  renderPassInfo.framebuffer = mSwapchainFramebuffers[imageIndex];
-  renderPassInfo.renderArea.offset = {0, 0};
-  renderPassInfo.renderArea.extent = mSwapchainExtent;
+  vkCmdEndRendering(commandBuffer);
 
-  vec<VkClearValue> clearValues{};
-  clearValues.resize(2);
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstAccessMask = 0;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = mSwapchainImages[imageIndex];
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.layerCount = 1;
 
-  clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-  clearValues[1].depthStencil = {1.0f, 0};
-  renderPassInfo.clearValueCount = static_cast<u32>(clearValues.size());
-  renderPassInfo.pClearValues = clearValues.data();
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+}
 
-  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
-                       VK_SUBPASS_CONTENTS_INLINE);
+void App::recordDraws(VkCommandBuffer commandBuffer,
+                      FrameSnapshot const &snapshot, u32 first, u32 count) {
   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                     mGraphicsPipeline);
 
@@ -1523,27 +2379,157 @@ void App::recordCommandBuffer(VkCommandBuffer commandBuffer, u32 imageIndex) {
   scissor.extent = mSwapchainExtent;
   vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-  VkBuffer vertexBuffers[] = {mVertexBuffer};
-  VkDeviceSize offsets[] = {0};
-  vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-  vkCmdBindIndexBuffer(commandBuffer, mIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+  if (mUseExtendedDynamicState) {
+    PipelineKey const &key = mPipelineKey;
+    vkCmdSetCullMode(commandBuffer, key.cullMode);
+    vkCmdSetFrontFace(commandBuffer, static_cast<VkFrontFace>(key.frontFace));
+    vkCmdSetPrimitiveTopology(commandBuffer,
+                              static_cast<VkPrimitiveTopology>(key.topology));
+    vkCmdSetDepthTestEnable(commandBuffer,
+                            key.hasFlag(PipelineKey::DEPTH_TEST_BIT));
+    vkCmdSetDepthWriteEnable(commandBuffer,
+                             key.hasFlag(PipelineKey::DEPTH_WRITE_BIT));
+    vkCmdSetDepthCompareOp(commandBuffer,
+                           static_cast<VkCompareOp>(key.depthCompareOp));
+    if (mCmdSetColorBlendEnable != nullptr) {
+      VkBool32 blendEnable = key.hasFlag(PipelineKey::BLEND_BIT);
+      mCmdSetColorBlendEnable(commandBuffer, 0, 1, &blendEnable);
+    }
+  }
+
+  // With push constants the set only carries the texture, so one bind serves
+  // every draw. The dynamic offset is still required but never read.
+  if (mUsePushConstants) {
+    u32 uniformOffset = 0;
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            mPipelineLayout, 0, 1,
+                            &mDescriptorSets[mCurrentFrame], 1,
+                            &uniformOffset);
+  }
+
+  MeshHandle boundMesh{};
+  for (u32 i = first; i < first + count; ++i) {
+    DrawItem const &draw = snapshot.draws[i];
+    if (!(draw.mesh == boundMesh)) {
+      VkBuffer vertexBuffers[] = {
+          mBuffers.getBuffer(mMeshes.getVertexBuffer(draw.mesh))};
+      VkDeviceSize offsets[] = {0};
+      vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+      vkCmdBindIndexBuffer(
+          commandBuffer, mBuffers.getBuffer(mMeshes.getIndexBuffer(draw.mesh)),
+          0, VK_INDEX_TYPE_UINT32);
+      boundMesh = draw.mesh;
+    }
+
+    if (mUsePushConstants) {
+      PushConstants constants{};
+      constants.mvp = mViewProj * draw.model;
+      vkCmdPushConstants(commandBuffer, mPipelineLayout,
+                         VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants),
+                         &constants);
+    } else {
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              mPipelineLayout, 0, 1,
+                              &mDescriptorSets[mCurrentFrame], 1,
+                              &mUniformOffsets[i]);
+    }
+    vkCmdDrawIndexedIndirect(commandBuffer, mCullBuffer,
+                             this->getCullCommandOffset(mCurrentFrame, i), 1,
+                             sizeof(VkDrawIndexedIndirectCommand));
+  }
+}
+
+u32 App::getRecordingTaskCount(u32 drawCount) const {
+  // Small draw lists are cheaper to record inline than to hand out.
+  u32 taskCount = std::min(mRecordingWorkers.getThreadCount(),
+                           drawCount / MIN_DRAWS_PER_RECORDING_TASK);
+  return taskCount > 1 ? taskCount : 0;
+}
+
+VkCommandBuffer App::recordSecondaryDraws(u32 task, u32 taskCount,
+                                          u32 imageIndex,
+                                          FrameSnapshot const &snapshot) {
+  VkCommandBuffer commandBuffer = mFrameCommandPools.acquire(
+      task + 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+  VkCommandBufferInheritanceRenderingInfo renderingInfo{};
+  renderingInfo.sType =
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+  renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+  renderingInfo.colorAttachmentCount = 1;
+  renderingInfo.pColorAttachmentFormats = &mSwapchainImageFormat;
+  renderingInfo.depthAttachmentFormat = mDepthFormat;
+  renderingInfo.rasterizationSamples = mMSAASamples;
+
+  VkCommandBufferInheritanceInfo inheritanceInfo{};
+  inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  if (mUseDynamicRendering) {
+    inheritanceInfo.pNext = &renderingInfo;
+  } else {
+    inheritanceInfo.renderPass = mRenderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = mSwapchainFramebuffers[imageIndex];
+  }
 
-  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          mPipelineLayout, 0, 1,
-                          &mDescriptorSets[mCurrentFrame], 0, nullptr);
-  vkCmdDrawIndexed(commandBuffer, static_cast<u32>(mIndices.size()), 1, 0, 0,
-                   0);
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+                    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to begin secondary recording.");
+  }
+
+  u32 drawCount = static_cast<u32>(snapshot.draws.size());
+  u32 first = drawCount * task / taskCount;
+  u32 last = drawCount * (task + 1) / taskCount;
+  this->recordDraws(commandBuffer, snapshot, first, last - first);
 
-  vkCmdEndRenderPass(commandBuffer);
   if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to record command buffer.");
+    throw std::runtime_error("Failed to record secondary command buffer.");
   }
+  return commandBuffer;
+}
+
+void App::benchmarkRecording() {
+  FrameSnapshot snapshot{};
+  snapshot.draws.assign(RECORDING_BENCHMARK_DRAWS, {mMesh, glm::mat4(1.0f)});
+  // Recorded but never submitted, so every draw can use the same offset.
+  mUniformOffsets.assign(RECORDING_BENCHMARK_DRAWS, 0);
+
+  static constexpr u32 ITERATIONS = 10;
+  std::cout << std::fixed << std::setprecision(2) << "[Recording] "
+            << RECORDING_BENCHMARK_DRAWS << " draws:";
+  for (u32 threads = 1; threads <= mRecordingWorkers.getThreadCount();
+       ++threads) {
+    auto start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < ITERATIONS; ++i) {
+      mFrameCommandPools.beginFrame(0);
+      mRecordingWorkers.run(threads, [&](u32 task) {
+        this->recordSecondaryDraws(task, threads, 0, snapshot);
+      });
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double ms =
+        std::chrono::duration<double, std::milli>(elapsed).count() / ITERATIONS;
+    std::cout << " " << threads << (threads == 1 ? " thread " : " threads ")
+              << ms << " ms;";
+  }
+  std::cout << std::defaultfloat << std::endl;
+
+  mUniformOffsets.clear();
 }
 
 void App::createSyncObjects() {
-  mImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+  mImageAvailableSemaphores.resize(mFramesInFlight);
   mRenderFinishedSemaphores.resize(mSwapchainImageViews.size());
-  mInFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+  mInFlightFences.assign(mFramesInFlight, VK_NULL_HANDLE);
+  mFrameSubmissions.assign(mFramesInFlight, 0);
+  mFrameLatency.init(mFramesInFlight);
+  if (!mDebugMode) {
+    mFrameLatency.setLogInterval(std::chrono::seconds(0));
+  }
 
   VkSemaphoreCreateInfo semaphoreInfo{};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1552,40 +2538,92 @@ void App::createSyncObjects() {
   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-  for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-    if (vkCreateSemaphore(mDevice, &semaphoreInfo, nullptr,
-                          &mImageAvailableSemaphores[i]) != VK_SUCCESS ||
-        vkCreateFence(mDevice, &fenceInfo, nullptr, &mInFlightFences[i]) !=
+  for (u32 i = 0; i < mFramesInFlight; ++i) {
+    if (vkCreateSemaphore(mDevice, &semaphoreInfo, mAllocator,
+                          &mImageAvailableSemaphores[i]) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create synchronization objects.");
+    }
+
+    // With a timeline the frame waits on the deletion queue's counter.
+    if (!mUseTimelineSemaphore &&
+        vkCreateFence(mDevice, &fenceInfo, mAllocator, &mInFlightFences[i]) !=
             VK_SUCCESS) {
       throw std::runtime_error("Failed to create synchronization objects.");
     }
   }
 
-  for (u32 i = 0; i < mSwapchainImageViews.size(); ++i) {
-    if (vkCreateSemaphore(mDevice, &semaphoreInfo, nullptr,
+  this->createRenderFinishedSemaphores();
+}
+
+void App::createRenderFinishedSemaphores() {
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  mRenderFinishedSemaphores.assign(mSwapchainImages.size(), VK_NULL_HANDLE);
+  for (u32 i = 0; i < mRenderFinishedSemaphores.size(); ++i) {
+    if (vkCreateSemaphore(mDevice, &semaphoreInfo, mAllocator,
                           &mRenderFinishedSemaphores[i]) != VK_SUCCESS) {
       throw std::runtime_error("Failed to create synchronization objects.");
     }
   }
 }
 
-void App::cleanupSwapchain() {
-  vkDestroyImageView(mDevice, mColorImageView, nullptr);
-  vkDestroyImage(mDevice, mColorImage, nullptr);
-  vkFreeMemory(mDevice, mColorImageMemory, nullptr);
+// Nothing in core Vulkan reports when a present has finished with its
+// swapchain and wait semaphore, and the deletion queue only tracks queue
+// submissions. What is relied on instead is that the presentation engine
+// consumes presents in queue order: once mFramesInFlight frames submitted
+// after the last present to the old swapchain have completed, that present
+// has executed its semaphore wait and the old images are no longer needed.
+void App::retireSwapchains(u64 submission, bool all) {
+  for (auto it = mRetiredSwapchains.begin();
+       it != mRetiredSwapchains.end();) {
+    if (!all && --it->framesLeft > 0) {
+      ++it;
+      continue;
+    }
 
-  vkDestroyImageView(mDevice, mDepthImageView, nullptr);
-  vkDestroyImage(mDevice, mDepthImage, nullptr);
-  vkFreeMemory(mDevice, mDepthImageMemory, nullptr);
+    mDeletionQueue.retire(submission, [this, retired = *it]() {
+      for (VkSemaphore semaphore : retired.renderFinished) {
+        vkDestroySemaphore(mDevice, semaphore, mAllocator);
+      }
+      vkDestroySwapchainKHR(mDevice, retired.swapchain, mAllocator);
+    });
+    it = mRetiredSwapchains.erase(it);
+  }
+}
+
+void App::cleanupSwapchain() {
+  // Frames still in flight may reference these, so they are destroyed once
+  // the last submission has completed instead of draining the device.
+  u64 submission = mDeletionQueue.getLastSubmission();
+
+  mDeletionQueue.retireImageView(submission, mColorImageView);
+  mDeletionQueue.retireImage(submission, mColorImage);
+  mDeletionQueue.retireImageView(submission, mDepthImageView);
+  mDeletionQueue.retireImage(submission, mDepthImage);
+  mDeletionQueue.retire(submission, [this, color = mColorImageMemory,
+                                     depth = mDepthImageMemory]() {
+    mMemoryTracker.free(color);
+    mMemoryTracker.free(depth);
+  });
 
   for (u32 i = 0; i < mSwapchainFramebuffers.size(); ++i) {
-    vkDestroyFramebuffer(mDevice, mSwapchainFramebuffers[i], nullptr);
+    mDeletionQueue.retireFramebuffer(submission, mSwapchainFramebuffers[i]);
   }
 
   for (u32 i = 0; i < mSwapchainImageViews.size(); ++i) {
-    vkDestroyImageView(mDevice, mSwapchainImageViews[i], nullptr);
+    mDeletionQueue.retireImageView(submission, mSwapchainImageViews[i]);
   }
-  vkDestroySwapchainKHR(mDevice, mSwapchain, nullptr);
+
+  // A present to the old swapchain may still be pending, so it and the
+  // semaphores those presents wait on outlive the last render submission;
+  // see retireSwapchains().
+  RetiredSwapchain retired{};
+  retired.swapchain = mSwapchain;
+  retired.renderFinished = std::move(mRenderFinishedSemaphores);
+  retired.framesLeft = mFramesInFlight;
+  mRetiredSwapchains.push_back(std::move(retired));
+  mRenderFinishedSemaphores.clear();
 }
 
 void App::recreateSwapchain() {
@@ -1595,14 +2633,25 @@ void App::recreateSwapchain() {
     SDL_GetWindowSizeInPixels(mWindow, &width, &height);
     SDL_WaitEvent(nullptr);
   }
-  vkDeviceWaitIdle(mDevice);
 
+  // Queued presents still refer to the old swapchain; their results are
+  // superseded by the recreation.
+  mPresentThread.drain();
+  mPresentThread.poll();
   this->cleanupSwapchain();
   this->createSwapchain();
+  mPipelineManager.setTarget(this->getPipelineTarget());
   this->createImageViews();
+  this->createRenderFinishedSemaphores();
   this->createColorResources();
   this->createDepthResources();
   this->createFramebuffers();
+  mUploadBatch.submit();
+  mSubmitScheduler.flush();
+
+  if (mCacheCommandBuffers) {
+    mCommandCache.resize(static_cast<u32>(mSwapchainImages.size()));
+  }
 }
 
 void App::initVulkan() {
@@ -1622,6 +2671,7 @@ void App::initVulkan() {
   this->createRenderPass();
   this->createDescriptorSetLayout();
   this->createGraphicsPipeline();
+  this->createCullPipeline();
 
   this->createColorResources();
   this->createDepthResources();
@@ -1633,15 +2683,26 @@ void App::initVulkan() {
 
   this->loadModel();
 
-  this->createVertexBuffer();
-  this->createIndexBuffer();
+  this->createMesh();
+  mUploadBatch.submit();
+  mSubmitScheduler.flush();
+  this->releaseGeometryCopies();
   this->createUniformBuffers();
+  this->createCullBuffer();
 
   this->createDescriptorPool();
   this->createDescriptorSets();
 
   this->createCommandBuffers();
   this->createSyncObjects();
+
+  if (mDebugMode) {
+    this->createMemoryReport().log(std::cout);
+    mUploadBatch.log(std::cout);
+  }
+  if (mBenchmarkRecording) {
+    this->benchmarkRecording();
+  }
 }
 
 bool App::pollEvents() {
@@ -1655,6 +2716,12 @@ bool App::pollEvents() {
     case SDL_EVENT_WINDOW_DESTROYED:
       return false;
 
+    case SDL_EVENT_KEY_DOWN:
+      if (!handle.key.repeat) {
+        this->handleKey(handle.key.key);
+      }
+      break;
+
     case SDL_EVENT_WINDOW_RESIZED:
     case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
       mFramebufferResized = true;
@@ -1667,185 +2734,436 @@ bool App::pollEvents() {
   return true;
 }
 
-void App::updateUniformBuffer(u32 currentImage) {
-  static auto startTime = std::chrono::high_resolution_clock::now();
+void App::handleKey(SDL_Keycode key) {
+  PipelineKey previous = mPipelineKey;
+  switch (key) {
+  case SDLK_B:
+    mPipelineKey.setFlag(PipelineKey::BLEND_BIT,
+                         !mPipelineKey.hasFlag(PipelineKey::BLEND_BIT));
+    break;
+
+  case SDLK_C:
+    mPipelineKey.cullMode = mPipelineKey.cullMode == VK_CULL_MODE_NONE
+                                ? VK_CULL_MODE_BACK_BIT
+                                : VK_CULL_MODE_NONE;
+    break;
+
+  case SDLK_T:
+    mPipelineKey.features ^= SHADER_FEATURE_TEXTURE;
+    break;
+
+  case SDLK_V:
+    mPipelineKey.features ^= SHADER_FEATURE_VERTEX_COLOR;
+    break;
+
+  case SDLK_U:
+    mPipelineKey.features ^= SHADER_FEATURE_TEX_COORD;
+    break;
+
+  case SDLK_A:
+    mPipelineKey.features ^= SHADER_FEATURE_ALPHA_TEST;
+    break;
 
-  auto currentTime = std::chrono::high_resolution_clock::now();
-  float time = std::chrono::duration<float, std::chrono::seconds::period>(
-                   currentTime - startTime)
-                   .count();
+  default:
+    break;
+  }
+
+  // Dynamic state is recorded into the cached command buffers, and changing
+  // it does not change the pipeline.
+  if (!(mPipelineKey == previous)) {
+    mCommandCache.invalidate();
+  }
+}
+
+void App::simulate(FrameSnapshot &snapshot, u64 step, float time) {
   time /= 4;
 
-  UniformBufferObject ubo{};
   float scale = (std::sin(time) + 1.0f) / 4.0f + 0.5f;
   float angle = time * glm::radians(90.0f);
   glm::mat4 model = glm::mat4(1.0f);
   model = glm::scale(model, glm::vec3(scale, scale, scale));
   model = glm::rotate(model, angle, glm::vec3(0.0f, 0.0f, 1.0f));
-  ubo.model = model;
-  ubo.view =
+
+  snapshot.step = step;
+  snapshot.view =
       glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f),
                   glm::vec3(0.0f, 0.0f, 1.0f));
-  ubo.proj = glm::perspective(
-      glm::radians(45.0f),
-      mSwapchainExtent.width / (float)mSwapchainExtent.height, 0.1f, 10.0f);
-  ubo.proj[1][1] *= -1;
-  std::memcpy(mUniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+  snapshot.fovY = glm::radians(45.0f);
+  snapshot.sceneVersion = mSceneVersion;
+  // clear() keeps the capacity, so steady state does not allocate.
+  snapshot.draws.clear();
+  snapshot.draws.push_back({mMesh, model});
+}
+
+void App::startSimulation() {
+  // Publish the first step before rendering starts so the render thread never
+  // sees an empty snapshot.
+  this->simulate(mSnapshots.getWriteBuffer(), 0, 0.0f);
+  mSnapshots.publish();
+
+  mSimulationRunning = true;
+  mSimulationThread = std::thread([this]() {
+    using Clock = std::chrono::steady_clock;
+    auto const interval =
+        std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) /
+        SIMULATION_RATE;
+    auto const startTime = Clock::now();
+
+    // Fixed steps: a slow step is caught up on rather than stretching time.
+    for (u64 step = 1; mSimulationRunning; ++step) {
+      auto stepTime = startTime + interval * step;
+      std::this_thread::sleep_until(stepTime);
+
+      float time = std::chrono::duration<float>(stepTime - startTime).count();
+      this->simulate(mSnapshots.getWriteBuffer(), step, time);
+      mSnapshots.publish();
+    }
+  });
 }
 
-void App::drawFrame() {
-  vkWaitForFences(mDevice, 1, &mInFlightFences[mCurrentFrame], VK_TRUE,
-                  UINT64_MAX);
+void App::stopSimulation() {
+  mSimulationRunning = false;
+  if (mSimulationThread.joinable()) {
+    mSimulationThread.join();
+  }
+}
 
-  u32 imageIndex;
-  VkResult result = vkAcquireNextImageKHR(
-      mDevice, mSwapchain, UINT64_MAX, mImageAvailableSemaphores[mCurrentFrame],
-      VK_NULL_HANDLE, &imageIndex);
+void App::updateUniformBuffer(u32 currentImage,
+                              FrameSnapshot const &snapshot) {
+  glm::mat4 proj = glm::perspective(
+      snapshot.fovY, mSwapchainExtent.width / (float)mSwapchainExtent.height,
+      0.1f, 10.0f);
+  proj[1][1] *= -1;
 
-  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-    this->recreateSwapchain();
+  // Shared by every draw; only the model matrix changes per object.
+  mViewProj = proj * snapshot.view;
+  mUniformRing.beginFrame(currentImage);
+  mUniformOffsets.clear();
+  // The transforms are pushed with each draw instead.
+  if (mUsePushConstants) {
     return;
-  } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-    throw std::runtime_error("Failed to acquire swap chain image.");
   }
+  for (auto const &draw : snapshot.draws) {
+    UniformBufferObject ubo{};
+    ubo.model = draw.model;
+    ubo.view = snapshot.view;
+    ubo.proj = proj;
+    mUniformOffsets.push_back(mUniformRing.push(ubo));
+  }
+}
 
-  vkResetFences(mDevice, 1, &mInFlightFences[mCurrentFrame]);
+VkSemaphore App::dispatchCulling(FrameSnapshot const &snapshot) {
+  u32 drawCount = static_cast<u32>(snapshot.draws.size());
+  if (drawCount > CULL_DRAW_CAPACITY) {
+    throw std::runtime_error("Too many draws to cull.");
+  }
 
-  vkResetCommandBuffer(mCommandBuffers[mCurrentFrame], 0);
-  this->recordCommandBuffer(mCommandBuffers[mCurrentFrame], imageIndex);
+  u8 *region = mCullMapped + mCurrentFrame * mCullFrameSize;
+  CullDraw *draws = reinterpret_cast<CullDraw *>(region);
+  for (u32 i = 0; i < drawCount; ++i) {
+    DrawItem const &draw = snapshot.draws[i];
+    glm::vec4 bounds = mMeshes.getBounds(draw.mesh);
+    glm::vec4 center = draw.model * glm::vec4(glm::vec3(bounds), 1.0f);
+    float scale = std::max({glm::length(glm::vec3(draw.model[0])),
+                            glm::length(glm::vec3(draw.model[1])),
+                            glm::length(glm::vec3(draw.model[2]))});
 
-  this->updateUniformBuffer(mCurrentFrame);
+    draws[i].sphere = glm::vec4(glm::vec3(center), bounds.w * scale);
+    draws[i].command = {mMeshes.getIndexCount(draw.mesh), 1, 0, 0, 0};
+  }
 
-  VkSubmitInfo submitInfo{};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  VkSemaphore waitSemaphores[] = {mImageAvailableSemaphores[mCurrentFrame]};
-  VkPipelineStageFlags waitStages[] = {
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &mCommandBuffers[mCurrentFrame];
+  // Frustum planes from the rows of the view-projection matrix, with the
+  // near plane at z = 0 for Vulkan's depth range.
+  glm::mat4 rows = glm::transpose(mViewProj);
+  CullConstants constants{};
+  constants.planes = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                      rows[3] - rows[1], rows[2],           rows[3] - rows[2]};
+  for (auto &plane : constants.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  constants.drawCount = drawCount;
 
-  VkSemaphore signalSemaphores[] = {mRenderFinishedSemaphores[imageIndex]};
-  submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pSignalSemaphores = signalSemaphores;
+  VkCommandBuffer commandBuffer = mAsyncCompute.begin(mCurrentFrame);
+  if (drawCount > 0) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      mCullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            mCullPipelineLayout, 0, 1,
+                            &mCullDescriptorSets[mCurrentFrame], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, mCullPipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+    vkCmdDispatch(commandBuffer,
+                  (drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+  }
+  return mAsyncCompute.submit(mCurrentFrame);
+}
 
-  if (vkQueueSubmit(mGraphicsQueue, 1, &submitInfo,
-                    mInFlightFences[mCurrentFrame]) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to submit draw command buffer.");
+void App::drawFrame() {
+  // Wait for the submission that last used this frame's resources,
+  // mFramesInFlight frames ago.
+  if (mUseTimelineSemaphore) {
+    mDeletionQueue.wait(mFrameSubmissions[mCurrentFrame]);
+  } else {
+    vkWaitForFences(mDevice, 1, &mInFlightFences[mCurrentFrame], VK_TRUE,
+                    UINT64_MAX);
+    mDeletionQueue.markCompleted(mFrameSubmissions[mCurrentFrame]);
   }
+  mDeletionQueue.collect();
+  mFrameLatency.update(mDeletionQueue);
+  mFrameLatency.beginFrame(mCurrentFrame);
+  mAsyncCompute.update(mCurrentFrame);
 
-  VkPresentInfoKHR presentInfo{};
-  presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-  presentInfo.waitSemaphoreCount = 1;
-  presentInfo.pWaitSemaphores = signalSemaphores;
+  u32 imageIndex;
+  VkResult result;
+  {
+    auto lock = mPresentThread.lockQueue();
+    result = vkAcquireNextImageKHR(mDevice, mSwapchain, UINT64_MAX,
+                                   mImageAvailableSemaphores[mCurrentFrame],
+                                   VK_NULL_HANDLE, &imageIndex);
+  }
 
-  VkSwapchainKHR swapChains[] = {mSwapchain};
-  presentInfo.swapchainCount = 1;
-  presentInfo.pSwapchains = swapChains;
-  presentInfo.pImageIndices = &imageIndex;
-  presentInfo.pResults = nullptr;
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    this->recreateSwapchain();
+    return;
+  } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+    throw std::runtime_error("Failed to acquire swap chain image.");
+  }
 
-  result = vkQueuePresentKHR(mPresentQueue, &presentInfo);
+  if (!mUseTimelineSemaphore) {
+    vkResetFences(mDevice, 1, &mInFlightFences[mCurrentFrame]);
+  }
+  this->updateRelocations();
+
+  // Take the newest simulation step; if none arrived since the last frame the
+  // previous snapshot is drawn again.
+  mSnapshots.acquire();
+  FrameSnapshot const &snapshot = mSnapshots.getReadBuffer();
+  this->updateUniformBuffer(mCurrentFrame, snapshot);
+
+  // A permutation still compiling is drawn with the default pipeline.
+  VkPipeline pipeline =
+      mPipelineManager.get(this->getCompiledKey(mPipelineKey),
+                           this->getCompiledKey(mDefaultPipelineKey));
+  if (pipeline != mGraphicsPipeline) {
+    mGraphicsPipeline = pipeline;
+    mCommandCache.invalidate();
+  }
+  // Submitted before recording so culling overlaps with the CPU work below
+  // and with the GPU finishing the previous frame.
+  VkSemaphore cullSemaphore = this->dispatchCulling(snapshot);
+
+  // The frame's previous submission has completed, so everything recorded
+  // for it is released with one reset per pool.
+  mFrameCommandPools.beginFrame(mCurrentFrame);
+  array<VkCommandBuffer, 2> commandBuffers{};
+  u32 commandBufferCount = 0;
+  if (mCacheCommandBuffers) {
+    if (mDefragmenter.isActive()) {
+      commandBuffers[commandBufferCount] = mFrameCommandPools.acquire(0);
+      this->recordRelocationPass(commandBuffers[commandBufferCount++]);
+    }
+    commandBuffers[commandBufferCount++] = mCommandCache.get(
+        imageIndex, mCurrentFrame, snapshot.sceneVersion,
+        [&](VkCommandBuffer commandBuffer) {
+          this->recordCommandBuffer(commandBuffer, imageIndex, snapshot, true);
+        });
+  } else {
+    commandBuffers[commandBufferCount] = mFrameCommandPools.acquire(0);
+    this->recordCommandBuffer(commandBuffers[commandBufferCount++], imageIndex,
+                              snapshot);
+  }
+
+  // Culling was queued on the compute queue above and goes out in the same
+  // flush, ahead of the graphics call that waits on it.
+  VkSemaphore imageAvailable = mImageAvailableSemaphores[mCurrentFrame];
+  mSubmitScheduler.wait(mGraphicsQueue, imageAvailable,
+                        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+  mSubmitScheduler.wait(mGraphicsQueue, cullSemaphore,
+                        VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT);
+  for (u32 i = 0; i < commandBufferCount; ++i) {
+    mSubmitScheduler.add(mGraphicsQueue, commandBuffers[i]);
+  }
+  mSubmitScheduler.signal(mGraphicsQueue, mRenderFinishedSemaphores[imageIndex],
+                          VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+  u64 submission = mDeletionQueue.registerSubmission();
+  if (mUseTimelineSemaphore) {
+    mSubmitScheduler.signal(mGraphicsQueue, mDeletionQueue.getTimeline(),
+                            VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, submission);
+  } else {
+    mSubmitScheduler.fence(mGraphicsQueue, mInFlightFences[mCurrentFrame]);
+  }
+  {
+    std::unique_lock<std::mutex> lock;
+    if (mPresentQueue == mGraphicsQueue || mPresentQueue == mComputeQueue) {
+      lock = mPresentThread.lockQueue();
+    }
+    mSubmitScheduler.flush();
+  }
+  mFrameSubmissions[mCurrentFrame] = submission;
+  mFrameLatency.submit(mCurrentFrame, submission);
+  this->retireSwapchains(submission, false);
 
-  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
-      mFramebufferResized) {
+  // With the present thread, out of date results of this present may only
+  // be reported on a later frame.
+  mPresentThread.push(
+      {mSwapchain, imageIndex, mRenderFinishedSemaphores[imageIndex]});
+  if (mPresentThread.poll() || mFramebufferResized) {
     mFramebufferResized = false;
     this->recreateSwapchain();
-  } else if (result != VK_SUCCESS) {
-    throw std::runtime_error("Failed to present swap chain image.");
   }
 
-  mCurrentFrame = (mCurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+  mCurrentFrame = (mCurrentFrame + 1) % mFramesInFlight;
+  ++mFrameCount;
+  mMemoryTracker.tick();
+  mFrameLatency.tick();
+  mAsyncCompute.tick();
 }
 
 void App::mainLoop() {
+  // SDL wants events pumped on the thread that created the window, so this
+  // thread renders and the simulation runs beside it.
+  this->startSimulation();
   while (this->pollEvents()) {
     this->drawFrame();
   }
+  this->stopSimulation();
+  mPresentThread.drain();
 
   vkDeviceWaitIdle(mDevice);
 }
 
 void App::cleanup() {
+  this->stopSimulation();
+  if (mDebugMode) {
+    mPresentThread.log(std::cout);
+  }
+  mPresentThread.destroy();
   this->cleanupSwapchain();
+  // The device is idle, so nothing is left to wait for.
+  this->retireSwapchains(mDeletionQueue.getLastSubmission(), true);
+
+  for (auto const &relocation : mPendingRelocations) {
+    this->destroyRelocation(relocation);
+  }
+  mUploadBatch.discard();
+  mDeletionQueue.flush();
+
+  this->destroyResources();
 
-  vkDestroySampler(mDevice, mTextureSampler, nullptr);
-  vkDestroyImageView(mDevice, mTextureImageView, nullptr);
-  vkDestroyImage(mDevice, mTexture, nullptr);
-  vkFreeMemory(mDevice, mTextureMemory, nullptr);
+  mUniformRing.destroy();
 
-  for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-    vkUnmapMemory(mDevice, mUniformBuffersMemory[i]);
-    vkDestroyBuffer(mDevice, mUniformBuffers[i], nullptr);
-    vkFreeMemory(mDevice, mUniformBuffersMemory[i], nullptr);
+  if (mCullBuffer != VK_NULL_HANDLE) {
+    vkUnmapMemory(mDevice, mCullMemory);
+    vkDestroyBuffer(mDevice, mCullBuffer, mAllocator);
+    mMemoryTracker.free(mCullMemory);
+    mCullBuffer = VK_NULL_HANDLE;
+    mCullMemory = VK_NULL_HANDLE;
+    mCullMapped = nullptr;
   }
 
-  vkDestroyDescriptorPool(mDevice, mDescriptorPool, nullptr);
-  vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, nullptr);
+  vkDestroyDescriptorPool(mDevice, mDescriptorPool, mAllocator);
+  vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, mAllocator);
+  vkDestroyDescriptorSetLayout(mDevice, mCullSetLayout, mAllocator);
 
-  vkDestroyBuffer(mDevice, mVertexBuffer, nullptr);
-  vkFreeMemory(mDevice, mVertexBufferMemory, nullptr);
+  if (mCullPipeline != VK_NULL_HANDLE) {
+    vkDestroyPipeline(mDevice, mCullPipeline, mAllocator);
+    mCullPipeline = VK_NULL_HANDLE;
+  }
+
+  if (mCullPipelineLayout != VK_NULL_HANDLE) {
+    vkDestroyPipelineLayout(mDevice, mCullPipelineLayout, mAllocator);
+    mCullPipelineLayout = VK_NULL_HANDLE;
+  }
+
+  if (mDebugMode) {
+    mPipelineManager.log(std::cout);
+  }
+  mPipelineManager.destroy();
+  mGraphicsPipeline = VK_NULL_HANDLE;
 
-  vkDestroyBuffer(mDevice, mIndexBuffer, nullptr);
-  vkFreeMemory(mDevice, mIndexBufferMemory, nullptr);
+  if (mFragShaderModule != VK_NULL_HANDLE) {
+    vkDestroyShaderModule(mDevice, mFragShaderModule, mAllocator);
+    mFragShaderModule = VK_NULL_HANDLE;
+  }
 
-  if (mGraphicsPipeline != VK_NULL_HANDLE) {
-    vkDestroyPipeline(mDevice, mGraphicsPipeline, nullptr);
-    mGraphicsPipeline = VK_NULL_HANDLE;
+  if (mVertShaderModule != VK_NULL_HANDLE) {
+    vkDestroyShaderModule(mDevice, mVertShaderModule, mAllocator);
+    mVertShaderModule = VK_NULL_HANDLE;
   }
 
   if (mPipelineLayout != VK_NULL_HANDLE) {
-    vkDestroyPipelineLayout(mDevice, mPipelineLayout, nullptr);
+    vkDestroyPipelineLayout(mDevice, mPipelineLayout, mAllocator);
     mPipelineLayout = VK_NULL_HANDLE;
   }
 
   if (mRenderPass != VK_NULL_HANDLE) {
-    vkDestroyRenderPass(mDevice, mRenderPass, nullptr);
+    vkDestroyRenderPass(mDevice, mRenderPass, mAllocator);
     mRenderPass = VK_NULL_HANDLE;
   }
 
-  for (u32 i = 0; i < mSwapchainImageViews.size(); ++i) {
-    if (mRenderFinishedSemaphores[i] != VK_NULL_HANDLE) {
-      vkDestroySemaphore(mDevice, mRenderFinishedSemaphores[i], nullptr);
-      mRenderFinishedSemaphores[i] = VK_NULL_HANDLE;
-    }
-  }
-
-  for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+  for (u32 i = 0; i < mFramesInFlight; ++i) {
     if (mInFlightFences[i] != VK_NULL_HANDLE) {
-      vkDestroyFence(mDevice, mInFlightFences[i], nullptr);
+      vkDestroyFence(mDevice, mInFlightFences[i], mAllocator);
       mInFlightFences[i] = VK_NULL_HANDLE;
     }
 
     if (mImageAvailableSemaphores[i] != VK_NULL_HANDLE) {
-      vkDestroySemaphore(mDevice, mImageAvailableSemaphores[i], nullptr);
+      vkDestroySemaphore(mDevice, mImageAvailableSemaphores[i], mAllocator);
       mImageAvailableSemaphores[i] = VK_NULL_HANDLE;
     }
   }
 
+  mDeletionQueue.destroy();
+
+  mRecordingWorkers.destroy();
+  mFrameCommandPools.destroy();
+  if (mDebugMode && mCacheCommandBuffers) {
+    mCommandCache.log(std::cout);
+  }
+  mCommandCache.destroy();
+  mAsyncCompute.destroy();
+  if (mDebugMode) {
+    mSubmitScheduler.log(std::cout);
+    mDefragmenter.log(std::cout);
+  }
+
   if (mCommandPool != VK_NULL_HANDLE) {
-    vkDestroyCommandPool(mDevice, mCommandPool, nullptr);
+    vkDestroyCommandPool(mDevice, mCommandPool, mAllocator);
     mCommandPool = VK_NULL_HANDLE;
   }
 
-  vkDestroyDevice(mDevice, nullptr);
+  if (mTransferCommandPool != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(mDevice, mTransferCommandPool, mAllocator);
+    mTransferCommandPool = VK_NULL_HANDLE;
+  }
 
+  mBlockAllocator.destroy();
   if (mDebugMode) {
-    this->destroyDebugUtilsMessengerEXT(nullptr);
+    mPipelineCache.log(std::cout);
+  }
+  mPipelineCache.destroy();
+  vkDestroyDevice(mDevice, mAllocator);
+
+  if (mDebugMode) {
+    this->destroyDebugUtilsMessengerEXT(mAllocator);
   }
 
   if (mSurface != VK_NULL_HANDLE) {
-    vkDestroySurfaceKHR(mInstance, mSurface, nullptr);
+    vkDestroySurfaceKHR(mInstance, mSurface, mAllocator);
     mSurface = VK_NULL_HANDLE;
   }
 
   if (mInstance != VK_NULL_HANDLE) {
-    vkDestroyInstance(mInstance, nullptr);
+    vkDestroyInstance(mInstance, mAllocator);
     mInstance = VK_NULL_HANDLE;
   }
 
+  if (mDebugMode) {
+    HostAllocator::get().log(std::cout);
+  }
+
   if (mWindow) {
     SDL_DestroyWindow(mWindow);
     mWindow = nullptr;
@@ -1854,8 +3172,21 @@ void App::cleanup() {
   SDL_Quit();
 }
 
-App::App(int const &width, int const &height, str const &title, bool debugMode)
-    : mDebugMode(debugMode) {
+App::App(int const &width, int const &height, str const &title, bool debugMode,
+         u32 framesInFlight, bool cacheCommandBuffers, bool forceRelocation)
+    : mDebugMode(debugMode), mForceRelocation(forceRelocation) {
+  if (cacheCommandBuffers) {
+    mCacheCommandBuffers = true;
+    mUsePushConstants = false;
+  }
+  mFramesInFlight = std::clamp(framesInFlight, MIN_FRAMES_IN_FLIGHT,
+                               FRAMES_IN_FLIGHT_LIMIT);
+  if (mFramesInFlight != framesInFlight) {
+    std::cerr << "WARNING: " << framesInFlight
+              << " frames in flight is out of range, using " << mFramesInFlight
+              << "." << std::endl;
+  }
+
   this->initWindow(width, height, title);
   this->initVulkan();
 }
@@ -1866,8 +3197,27 @@ void App::run() { this->mainLoop(); }
 
 } // namespace VulkanTutorial::Chapter11
 
-int main() {
-  VulkanTutorial::Chapter11::App app;
+int main(int argc, char **argv) {
+  // Usage: Chapter11 [frames in flight] [--cache-commands]
+  //                  [--force-relocation]
+  VulkanTutorial::u32 framesInFlight = VulkanTutorial::MAX_FRAMES_IN_FLIGHT;
+  bool cacheCommandBuffers = false;
+  bool forceRelocation = false;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--cache-commands") == 0) {
+      cacheCommandBuffers = true;
+    } else if (std::strcmp(argv[i], "--force-relocation") == 0) {
+      forceRelocation = true;
+    } else {
+      framesInFlight =
+          static_cast<VulkanTutorial::u32>(std::strtoul(argv[i], nullptr, 10));
+    }
+  }
+
+  VulkanTutorial::Chapter11::App app(
+      VulkanTutorial::WINDOW_WIDTH, VulkanTutorial::WINDOW_HEIGHT,
+      "Vulkan Tutorial", true, framesInFlight, cacheCommandBuffers,
+      forceRelocation);
 
   try {
     app.run();
@@ -330,6 +330,8 @@ void App::createLogicalDevice() {
       VK_SUCCESS) {
     throw std::runtime_error("Failed to create logical device.");
   }
+
+  mPipelineCache.init(mPhysicalDevice, mDevice, nullptr, "Chapter4");
 }
 
 void App::createQueue() {
@@ -462,11 +464,11 @@ void App::createImageViews() {
   }
 }
 
-VkShaderModule App::createShaderModule(vec<char> const &code) {
+VkShaderModule App::createShaderModule(ShaderCode const &code) {
   VkShaderModuleCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  createInfo.codeSize = code.size();
-  createInfo.pCode = reinterpret_cast<u32 const *>(code.data());
+  createInfo.codeSize = code.size;
+  createInfo.pCode = code.code;
 
   VkShaderModule shaderModule;
   if (vkCreateShaderModule(mDevice, &createInfo, nullptr, &shaderModule) !=
@@ -521,8 +523,8 @@ void App::createRenderPass() {
 }
 
 void App::createGraphicsPipeline() {
-  vec<char> vert = Util::readFile("assets/shaders/chapter4/shader.vert.spv");
-  vec<char> frag = Util::readFile("assets/shaders/chapter4/shader.frag.spv");
+  ShaderCode vert = ShaderRegistry::get().find("chapter4/shader.vert");
+  ShaderCode frag = ShaderRegistry::get().find("chapter4/shader.frag");
 
   VkShaderModule vertShaderModule = this->createShaderModule(vert);
   VkShaderModule fragShaderModule = this->createShaderModule(frag);
@@ -645,8 +647,8 @@ void App::createGraphicsPipeline() {
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
   pipelineInfo.basePipelineIndex = -1;
 
-  if (vkCreateGraphicsPipelines(mDevice, nullptr, 1, &pipelineInfo, nullptr,
-                                &mGraphicsPipeline) != VK_SUCCESS) {
+  if (mPipelineCache.createGraphicsPipeline(pipelineInfo, nullptr,
+                                            &mGraphicsPipeline) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create graphics pipeline.");
   }
 
@@ -963,6 +965,10 @@ void App::cleanup() {
     mCommandPool = VK_NULL_HANDLE;
   }
 
+  if (mDebugMode) {
+    mPipelineCache.log(std::cout);
+  }
+  mPipelineCache.destroy();
   vkDestroyDevice(mDevice, nullptr);
 
   if (mDebugMode) {
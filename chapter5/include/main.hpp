@@ -1,6 +1,8 @@
 #pragma once
 
 #include <common.hpp>
+#include <pipeline_cache.hpp>
+#include <shader_registry.hpp>
 #include <util.hpp>
 
 namespace VulkanTutorial::Chapter5 {
@@ -43,6 +45,7 @@ private:
   VkRenderPass mRenderPass = VK_NULL_HANDLE;
   VkDescriptorSetLayout mDescriptorSetLayout = VK_NULL_HANDLE;
   VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
+  PipelineCache mPipelineCache;
   VkPipeline mGraphicsPipeline = VK_NULL_HANDLE;
   vec<VkFramebuffer> mSwapchainFramebuffers;
 
@@ -96,7 +99,7 @@ private:
   void createSwapchain();
   void createImageViews();
 
-  VkShaderModule createShaderModule(vec<char> const &code);
+  VkShaderModule createShaderModule(ShaderCode const &code);
 
   void createCommandPool();
 
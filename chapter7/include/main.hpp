@@ -1,6 +1,8 @@
 #pragma once
 
 #include <common.hpp>
+#include <pipeline_cache.hpp>
+#include <shader_registry.hpp>
 #include <util.hpp>
 
 namespace VulkanTutorial::Chapter7 {
@@ -52,6 +54,7 @@ private:
   VkRenderPass mRenderPass = VK_NULL_HANDLE;
   VkDescriptorSetLayout mDescriptorSetLayout = VK_NULL_HANDLE;
   VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
+  PipelineCache mPipelineCache;
   VkPipeline mGraphicsPipeline = VK_NULL_HANDLE;
   vec<VkFramebuffer> mSwapchainFramebuffers;
 
@@ -118,7 +121,7 @@ private:
   void createSwapchain();
   void createImageViews();
 
-  VkShaderModule createShaderModule(vec<char> const &code);
+  VkShaderModule createShaderModule(ShaderCode const &code);
 
   void createCommandPool();
 
@@ -0,0 +1,37 @@
+# Writes the SPIR-V module INPUT to OUTPUT as a constexpr u32 array that
+# registers itself with ShaderRegistry under NAME.
+# Usage: cmake -DNAME=... -DINPUT=... -DOUTPUT=... -P embed_spirv.cmake
+
+file(READ ${INPUT} hex HEX)
+string(LENGTH "${hex}" length)
+math(EXPR remainder "${length} % 8")
+if(length EQUAL 0 OR NOT remainder EQUAL 0)
+  message(FATAL_ERROR "${INPUT} is not a SPIR-V module.")
+endif()
+
+# The file is a little-endian word stream.
+string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u;" words "${hex}")
+set(body "")
+set(column 0)
+foreach(word ${words})
+  if(column EQUAL 6)
+    string(APPEND body "\n   ")
+    set(column 0)
+  endif()
+  string(APPEND body " ${word},")
+  math(EXPR column "${column} + 1")
+endforeach()
+
+file(WRITE ${OUTPUT} "// Generated from ${NAME} by embed_spirv.cmake.
+#include <shader_registry.hpp>
+
+namespace {
+alignas(16) constexpr VulkanTutorial::u32 CODE[] = {
+   ${body}
+};
+
+[[maybe_unused]] bool const REGISTERED =
+    VulkanTutorial::ShaderRegistry::get().add(\"${NAME}\", CODE,
+                                              sizeof(CODE));
+} // namespace
+")
@@ -0,0 +1,76 @@
+find_program(GLSLC_EXECUTABLE glslc HINTS $ENV{VULKAN_SDK}/bin)
+if(GLSLC_EXECUTABLE)
+  message(STATUS "[SYSTEM] Compiling shaders with ${GLSLC_EXECUTABLE}.")
+else()
+  message(STATUS "[SYSTEM] glslc not found, embedding the prebuilt SPIR-V.")
+endif()
+
+set(EMBED_SPIRV_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/embed_spirv.cmake)
+
+# Compiles assets/shaders/<chapter>/* and links the SPIR-V into target,
+# registered with ShaderRegistry as "<chapter>/<file name>". Without glslc
+# the .spv files next to the sources are embedded instead; those must come
+# from glslc (assets/compile.sh). A chapter missing one is left out of the
+# default build rather than stopping the configure of the others.
+function(embed_shaders target chapter)
+  set(source_dir ${CMAKE_SOURCE_DIR}/assets/shaders/${chapter})
+  set(output_dir ${CMAKE_CURRENT_BINARY_DIR}/shaders)
+  file(GLOB sources CONFIGURE_DEPENDS
+    ${source_dir}/*.vert
+    ${source_dir}/*.frag
+    ${source_dir}/*.comp
+  )
+
+  if(NOT GLSLC_EXECUTABLE)
+    set(missing)
+    foreach(source ${sources})
+      if(NOT EXISTS ${source}.spv)
+        get_filename_component(name ${source} NAME)
+        list(APPEND missing ${chapter}/${name})
+      endif()
+    endforeach()
+    if(missing)
+      list(JOIN missing ", " missing)
+      message(WARNING "[SYSTEM] Skipping ${target}: no prebuilt SPIR-V for "
+                      "${missing}; install glslc or run assets/compile.sh.")
+      set_target_properties(${target} PROPERTIES EXCLUDE_FROM_ALL TRUE)
+      # Shaders such as the culling pass are loaded unconditionally, so an
+      # explicit build fails here instead of producing a broken executable.
+      add_custom_target(${target}MissingShaders
+        COMMAND ${CMAKE_COMMAND} -E echo
+                "${target} needs glslc or prebuilt SPIR-V for ${missing}."
+        COMMAND ${CMAKE_COMMAND} -E false
+        VERBATIM
+      )
+      add_dependencies(${target} ${target}MissingShaders)
+      return()
+    endif()
+  endif()
+
+  foreach(source ${sources})
+    get_filename_component(name ${source} NAME)
+    if(GLSLC_EXECUTABLE)
+      set(spirv ${output_dir}/${name}.spv)
+      add_custom_command(
+        OUTPUT ${spirv}
+        COMMAND ${GLSLC_EXECUTABLE} ${source} -o ${spirv}
+        DEPENDS ${source}
+        COMMENT "Compiling ${chapter}/${name}"
+        VERBATIM
+      )
+    else()
+      set(spirv ${source}.spv)
+    endif()
+
+    set(embedded ${output_dir}/${name}.cpp)
+    add_custom_command(
+      OUTPUT ${embedded}
+      COMMAND ${CMAKE_COMMAND} -DNAME=${chapter}/${name} -DINPUT=${spirv}
+              -DOUTPUT=${embedded} -P ${EMBED_SPIRV_SCRIPT}
+      DEPENDS ${spirv} ${EMBED_SPIRV_SCRIPT}
+      COMMENT "Embedding ${chapter}/${name}"
+      VERBATIM
+    )
+    target_sources(${target} PRIVATE ${embedded})
+  endforeach()
+endfunction()
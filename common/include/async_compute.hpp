@@ -0,0 +1,90 @@
+#pragma once
+
+#include <common.hpp>
+#include <frame_command_pools.hpp>
+#include <submit_scheduler.hpp>
+
+namespace VulkanTutorial {
+
+// Per-frame compute work submitted ahead of the graphics submission of the
+// same frame. With a compute family separate from graphics the work runs on
+// its own queue and overlaps with rasterization of the previous frame; the
+// graphics submission waits on the semaphore returned by submit(). Without
+// one, the graphics queue is passed in and the same code path runs in order.
+// submit() queues the work on a SubmitScheduler, which must be flushed
+// before or together with the graphics work that waits on it.
+//
+// When both families support timestamps, the compute and graphics work of
+// every frame is timed and the overlap of each frame's compute work with the
+// previous frame's graphics work is reported.
+class AsyncCompute {
+private:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr u32 QUERIES_PER_FRAME = 4;
+
+  struct Interval {
+    u64 begin = 0;
+    u64 end = 0;
+  };
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkAllocationCallbacks const *mAllocator = nullptr;
+  SubmitScheduler *mScheduler = nullptr;
+  VkQueue mQueue = VK_NULL_HANDLE;
+  u32 mFamily = 0;
+  bool mDedicated = false;
+
+  FrameCommandPools mCommandPools;
+  vec<VkCommandBuffer> mCommandBuffers;
+  vec<VkSemaphore> mSemaphores;
+
+  VkQueryPool mQueryPool = VK_NULL_HANDLE;
+  double mTimestampPeriod = 1.0; // Nanoseconds per tick
+  u64 mTimestampMask = ~0ull;
+  vec<bool> mPendingQueries;
+  Interval mPreviousGraphics{};
+
+  double mComputeTotal = 0.0; // Nanoseconds
+  double mOverlapTotal = 0.0;
+  u64 mSamples = 0;
+
+  Clock::duration mLogInterval = std::chrono::seconds(5);
+  Clock::time_point mLastLog{};
+
+private:
+  void resetWindow();
+
+public:
+  AsyncCompute() = default;
+  AsyncCompute(AsyncCompute const &) = delete;
+  AsyncCompute &operator=(AsyncCompute const &) = delete;
+
+  bool isDedicated() const { return mDedicated; }
+  bool hasTimestamps() const { return mQueryPool != VK_NULL_HANDLE; }
+
+  void setLogInterval(Clock::duration interval) { mLogInterval = interval; }
+
+  void init(VkPhysicalDevice physicalDevice, VkDevice device,
+            VkAllocationCallbacks const *allocator, SubmitScheduler *scheduler,
+            VkQueue queue, u32 family, u32 graphicsFamily, u32 frameCount);
+  void destroy();
+
+  // The frame's previous graphics submission must have completed, which
+  // also covers the compute submission it waited on.
+  VkCommandBuffer begin(u32 frame);
+  VkSemaphore submit(u32 frame);
+
+  // Bracket the graphics work of the frame, outside of any render pass.
+  void beginGraphics(VkCommandBuffer commandBuffer, u32 frame) const;
+  void endGraphics(VkCommandBuffer commandBuffer, u32 frame) const;
+
+  // Reads the timestamps of the frame's last submission once it completed.
+  void update(u32 frame);
+
+  void tick();
+  void log(std::ostream &stream) const;
+};
+
+} // namespace VulkanTutorial
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <common.hpp>
+#include <memory_tracker.hpp>
+
+namespace VulkanTutorial {
+
+struct MemoryAllocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  u32 blockId = 0;
+
+  bool isValid() const { return memory != VK_NULL_HANDLE; }
+  bool operator==(MemoryAllocation const &other) const {
+    return memory == other.memory && offset == other.offset;
+  }
+};
+
+struct MemoryBlockStats {
+  u32 id = 0;
+  u32 memoryTypeIndex = 0;
+  MemoryCategory category = MemoryCategory::GEOMETRY;
+  VkDeviceSize size = 0;
+  VkDeviceSize used = 0;
+  u32 allocationCount = 0;
+
+  float occupancy() const { return size ? float(used) / float(size) : 0.0f; }
+};
+
+// Sub-allocates buffers and images from large VkDeviceMemory blocks. Blocks
+// are never shared between categories, so buffers and optimal images never
+// have to respect bufferImageGranularity against each other.
+class BlockAllocator {
+private:
+  struct Range {
+    VkDeviceSize size = 0;
+    u64 userData = 0;
+  };
+
+  struct Block {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    VkDeviceSize used = 0;
+    u32 memoryTypeIndex = 0;
+    MemoryCategory category = MemoryCategory::GEOMETRY;
+    map<VkDeviceSize, VkDeviceSize> freeRanges; // offset -> size
+    map<VkDeviceSize, Range> allocations;       // offset -> allocation
+  };
+
+private:
+  MemoryTracker *mTracker = nullptr;
+  VkDeviceSize mBlockSize = 64ull * 1024 * 1024;
+  u32 mNextBlockId = 1;
+  map<u32, Block> mBlocks;
+
+private:
+  bool tryAllocate(u32 blockId, Block &block,
+                   VkMemoryRequirements const &requirements, u64 userData,
+                   MemoryAllocation &allocation);
+  u32 createBlock(VkDeviceSize size, u32 memoryTypeIndex,
+                  MemoryCategory category);
+
+public:
+  BlockAllocator() = default;
+  BlockAllocator(BlockAllocator const &) = delete;
+  BlockAllocator &operator=(BlockAllocator const &) = delete;
+
+  void init(MemoryTracker *tracker, VkDeviceSize blockSize);
+  void destroy();
+
+  MemoryAllocation allocate(VkMemoryRequirements const &requirements,
+                            u32 memoryTypeIndex, MemoryCategory category,
+                            u64 userData,
+                            vec<u32> const &excludedBlocks = {},
+                            bool allowNewBlock = true);
+  void free(MemoryAllocation const &allocation);
+
+  vec<MemoryBlockStats> getBlockStats() const;
+  vec<std::pair<u64, MemoryAllocation>> getAllocations(u32 blockId) const;
+};
+
+} // namespace VulkanTutorial
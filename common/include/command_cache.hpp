@@ -0,0 +1,56 @@
+#pragma once
+
+#include <common.hpp>
+
+namespace VulkanTutorial {
+
+using CommandRecorder = std::function<void(VkCommandBuffer commandBuffer)>;
+
+// Primary command buffers recorded once per (swapchain image, frame slot) and
+// replayed while the scene they were recorded for is unchanged. The caller
+// describes the scene with a version number and calls invalidate() whenever
+// anything baked into the recording changes (framebuffers, buffer handles,
+// descriptor sets). A buffer is only re-recorded on its own frame slot, after
+// that slot's previous submission has completed, so it is never reset while
+// pending.
+class CommandCache {
+private:
+  struct Entry {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    u64 version = 0;
+    bool valid = false;
+  };
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkAllocationCallbacks const *mAllocator = nullptr;
+  VkCommandPool mPool = VK_NULL_HANDLE;
+  u32 mFrameCount = 0;
+  vec<Entry> mEntries; // [image * frameCount + frame]
+
+  u64 mHits = 0;
+  u64 mMisses = 0;
+
+public:
+  CommandCache() = default;
+  CommandCache(CommandCache const &) = delete;
+  CommandCache &operator=(CommandCache const &) = delete;
+
+  u64 getHits() const { return mHits; }
+  u64 getMisses() const { return mMisses; }
+
+  void init(VkDevice device, VkAllocationCallbacks const *allocator,
+            u32 queueFamily, u32 frameCount);
+  void destroy();
+
+  // Makes room for imageCount swapchain images and invalidates every entry.
+  void resize(u32 imageCount);
+  void invalidate();
+
+  VkCommandBuffer get(u32 image, u32 frame, u64 version,
+                      CommandRecorder const &record);
+
+  void log(std::ostream &stream) const;
+};
+
+} // namespace VulkanTutorial
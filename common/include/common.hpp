@@ -4,14 +4,23 @@
 #include <SDL3/SDL_vulkan.h>
 #include <vulkan/vulkan.hpp>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <climits>
+#include <condition_variable>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -47,6 +56,7 @@ typedef uint64_t u64;
 
 template <typename T, size_t N> using array = std::array<T, N>;
 template <typename T> using vec = std::vector<T>;
+template <typename K, typename V> using map = std::map<K, V>;
 template <typename K, typename V> using umap = std::unordered_map<K, V>;
 template <typename T> using uset = std::unordered_set<T>;
 
@@ -67,6 +77,8 @@ static constexpr char const *DEVICE_EXTENSIONS[] = {
 struct QueueFamilyIndices {
   i32 graphicsFamily = -1;
   i32 presentFamily = -1;
+  i32 transferFamily = -1; // Only set for a dedicated transfer family
+  i32 computeFamily = -1;  // Only set for a compute family without graphics
 
   bool isComplete() const { return graphicsFamily * presentFamily >= 0; }
   operator uset<i32>() const;
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <block_allocator.hpp>
+#include <common.hpp>
+
+#include <deque>
+
+namespace VulkanTutorial {
+
+struct DefragmentationBudget {
+  VkDeviceSize maxBytesPerFrame = 16ull * 1024 * 1024;
+  std::chrono::microseconds maxTimePerFrame = std::chrono::microseconds(500);
+  float occupancyThreshold = 0.5f;
+};
+
+// Moves one allocation out of the source blocks. The callback owns the GPU
+// copy and the patching of everything that references the resource, and
+// returns false if the resource could not be moved (e.g. it was already
+// released or no compact destination was found).
+using DefragmentationCallback =
+    std::function<bool(u64 userData, MemoryAllocation const &allocation,
+                       vec<u32> const &sourceBlocks)>;
+
+class Defragmenter {
+private:
+  struct Move {
+    u64 userData = 0;
+    MemoryAllocation allocation{};
+  };
+
+private:
+  BlockAllocator *mAllocator = nullptr;
+  DefragmentationBudget mBudget{};
+
+  vec<u32> mSourceBlocks;
+  std::deque<Move> mMoves;
+
+  VkDeviceSize mMovedBytes = 0;
+  u32 mMovedCount = 0;
+
+public:
+  Defragmenter() = default;
+
+  bool isActive() const { return !mMoves.empty(); }
+  VkDeviceSize getMovedBytes() const { return mMovedBytes; }
+  u32 getMovedCount() const { return mMovedCount; }
+
+  void init(BlockAllocator *allocator, DefragmentationBudget const &budget);
+
+  bool beginPass();
+  u32 step(DefragmentationCallback const &callback);
+
+  void log(std::ostream &stream) const;
+};
+
+} // namespace VulkanTutorial
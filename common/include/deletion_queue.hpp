@@ -0,0 +1,79 @@
+#pragma once
+
+#include <common.hpp>
+
+namespace VulkanTutorial {
+
+using DeletionCallback = std::function<void()>;
+
+// Defers destruction of GPU objects until the submissions that use them have
+// finished. Every queue submission is given an increasing value; a resource
+// is retired against the last value that may still reference it and is
+// destroyed once that value is known to be complete, either because the
+// caller reported it or because a watched fence signaled.
+//
+// A fence signal covers every earlier submission on the same queue, so the
+// values are treated as a single timeline. When timeline semaphores are
+// available that is literal: every registered submission signals its value
+// on one VK_SEMAPHORE_TYPE_TIMELINE semaphore and progress is read from the
+// counter instead of from fences.
+class DeletionQueue {
+private:
+  struct Entry {
+    u64 value = 0;
+    DeletionCallback destroy;
+  };
+
+  struct WatchedFence {
+    u64 value = 0;
+    VkFence fence = VK_NULL_HANDLE;
+  };
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkAllocationCallbacks const *mAllocator = nullptr;
+  VkSemaphore mTimeline = VK_NULL_HANDLE;
+
+  u64 mLastSubmission = 0;
+  u64 mCompletedValue = 0;
+  vec<Entry> mEntries;
+  vec<WatchedFence> mWatchedFences;
+
+  u64 mDestroyedCount = 0;
+
+public:
+  DeletionQueue() = default;
+  DeletionQueue(DeletionQueue const &) = delete;
+  DeletionQueue &operator=(DeletionQueue const &) = delete;
+
+  bool hasTimeline() const { return mTimeline != VK_NULL_HANDLE; }
+  VkSemaphore getTimeline() const { return mTimeline; }
+  u64 getLastSubmission() const { return mLastSubmission; }
+  u64 getCompletedValue() const { return mCompletedValue; }
+  bool isComplete(u64 value) const { return value <= mCompletedValue; }
+  size_t getPendingCount() const { return mEntries.size(); }
+  u64 getDestroyedCount() const { return mDestroyedCount; }
+
+  void init(VkDevice device, VkAllocationCallbacks const *allocator,
+            bool useTimeline = false);
+  void destroy();
+
+  u64 registerSubmission() { return ++mLastSubmission; }
+  void markCompleted(u64 value);
+  void watch(u64 value, VkFence fence);
+  // Blocks until value is complete. Without a timeline this needs a watched
+  // fence at or after value and returns false if there is none.
+  bool wait(u64 value);
+
+  void retire(u64 value, DeletionCallback const &destroy);
+  void retireBuffer(u64 value, VkBuffer buffer);
+  void retireImage(u64 value, VkImage image);
+  void retireImageView(u64 value, VkImageView view);
+  void retireFramebuffer(u64 value, VkFramebuffer framebuffer);
+  void retirePipeline(u64 value, VkPipeline pipeline);
+
+  u32 collect();
+  void flush();
+};
+
+} // namespace VulkanTutorial
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <common.hpp>
+
+namespace VulkanTutorial {
+
+// TRANSIENT command pools, one per frame in flight and recording thread.
+// Once the caller knows a frame's previous submission has completed,
+// beginFrame() releases everything recorded for it with one
+// vkResetCommandPool per thread. Command buffers are then handed out again
+// in allocation order, so steady state allocates nothing. A thread only
+// ever touches its own pool, which is what lets several threads record at
+// once.
+class FrameCommandPools {
+private:
+  struct Pool {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    vec<VkCommandBuffer> primaries;
+    vec<VkCommandBuffer> secondaries;
+    u32 usedPrimaries = 0;
+    u32 usedSecondaries = 0;
+  };
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkAllocationCallbacks const *mAllocator = nullptr;
+  u32 mThreadCount = 0;
+  u32 mFrame = 0;
+  vec<Pool> mPools; // [frame * threadCount + thread]
+
+public:
+  FrameCommandPools() = default;
+  FrameCommandPools(FrameCommandPools const &) = delete;
+  FrameCommandPools &operator=(FrameCommandPools const &) = delete;
+
+  u32 getThreadCount() const { return mThreadCount; }
+  u32 getAllocatedCount() const;
+
+  void init(VkDevice device, VkAllocationCallbacks const *allocator,
+            u32 queueFamily, u32 frameCount, u32 threadCount);
+  void destroy();
+
+  void beginFrame(u32 frame);
+  VkCommandBuffer
+  acquire(u32 thread,
+          VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+};
+
+} // namespace VulkanTutorial
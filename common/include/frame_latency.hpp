@@ -0,0 +1,61 @@
+#pragma once
+
+#include <common.hpp>
+#include <deletion_queue.hpp>
+
+namespace VulkanTutorial {
+
+// Measures how long each frame takes from the CPU starting it to the GPU
+// finishing its submission. Completion is observed when update() runs, so a
+// sample is an upper bound; with the wait at the top of the frame loop the
+// frame the CPU is actually blocked on is measured exactly.
+class FrameLatency {
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Frame {
+    Clock::time_point start{};
+    u64 submission = 0;
+    bool pending = false;
+  };
+
+private:
+  vec<Frame> mFrames;
+
+  Clock::duration mLast{};
+  Clock::duration mTotal{};
+  Clock::duration mMin = Clock::duration::max();
+  Clock::duration mMax{};
+  u64 mSamples = 0;
+
+  Clock::duration mLogInterval = std::chrono::seconds(5);
+  Clock::time_point mLastLog{};
+
+private:
+  void resetWindow();
+
+public:
+  FrameLatency() = default;
+  FrameLatency(FrameLatency const &) = delete;
+  FrameLatency &operator=(FrameLatency const &) = delete;
+
+  u32 getFramesInFlight() const { return static_cast<u32>(mFrames.size()); }
+  Clock::duration getLast() const { return mLast; }
+  Clock::duration getAverage() const {
+    return mSamples > 0 ? mTotal / static_cast<i64>(mSamples)
+                        : Clock::duration{};
+  }
+
+  void setLogInterval(Clock::duration interval) { mLogInterval = interval; }
+
+  void init(u32 framesInFlight);
+
+  void beginFrame(u32 frame);
+  void submit(u32 frame, u64 submission);
+  void update(DeletionQueue const &progress);
+
+  void tick();
+  void log(std::ostream &stream) const;
+};
+
+} // namespace VulkanTutorial
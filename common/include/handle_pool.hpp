@@ -0,0 +1,145 @@
+#pragma once
+
+#include <common.hpp>
+
+#include <tuple>
+
+namespace VulkanTutorial {
+
+// Index into a HandlePool plus the generation of the slot it was issued
+// for. The tag only exists to keep handles of different pools apart.
+template <typename Tag> struct Handle {
+  static constexpr u32 INVALID_INDEX = UINT32_MAX;
+
+  u32 index = INVALID_INDEX;
+  u32 generation = 0;
+
+  bool isValid() const { return index != INVALID_INDEX; }
+  bool operator==(Handle const &other) const = default;
+};
+
+// Structure-of-arrays storage addressed through generational handles. Each
+// field lives in its own dense array so iterating over one field touches
+// only that field. Handles go through a sparse slot table, which makes
+// lookups O(1) and lets destroy() swap the last element into the hole
+// without invalidating other handles. A slot's generation is bumped when it
+// is freed, so stale handles are detected instead of aliasing a new entry.
+template <typename Tag, typename... Fields> class HandlePool {
+public:
+  using HandleType = Handle<Tag>;
+
+private:
+  struct Slot {
+    u32 dense = HandleType::INVALID_INDEX;
+    u32 generation = 1;
+  };
+
+private:
+  vec<Slot> mSlots;
+  vec<u32> mFreeSlots;
+  vec<u32> mDenseToSlot;
+  std::tuple<vec<Fields>...> mFields;
+
+private:
+  u32 getDenseIndex(HandleType handle) const {
+    if (!this->contains(handle)) {
+      throw std::runtime_error("Stale or invalid resource handle.");
+    }
+    return mSlots[handle.index].dense;
+  }
+
+public:
+  HandlePool() = default;
+  HandlePool(HandlePool const &) = delete;
+  HandlePool &operator=(HandlePool const &) = delete;
+
+  u32 size() const { return static_cast<u32>(mDenseToSlot.size()); }
+  bool empty() const { return mDenseToSlot.empty(); }
+  bool contains(HandleType handle) const {
+    return handle.index < mSlots.size() &&
+           mSlots[handle.index].generation == handle.generation &&
+           mSlots[handle.index].dense != HandleType::INVALID_INDEX;
+  }
+
+  HandleType getHandle(u32 denseIndex) const {
+    u32 slot = mDenseToSlot[denseIndex];
+    return {slot, mSlots[slot].generation};
+  }
+
+  template <size_t I> auto &get(HandleType handle) {
+    return std::get<I>(mFields)[this->getDenseIndex(handle)];
+  }
+  template <size_t I> auto const &get(HandleType handle) const {
+    return std::get<I>(mFields)[this->getDenseIndex(handle)];
+  }
+  template <size_t I> auto const &getDense() const {
+    return std::get<I>(mFields);
+  }
+
+  void reserve(u32 capacity) {
+    mSlots.reserve(capacity);
+    mDenseToSlot.reserve(capacity);
+    std::apply([capacity](auto &...fields) { (fields.reserve(capacity), ...); },
+               mFields);
+  }
+
+  HandleType create(Fields const &...values) {
+    u32 slot;
+    if (!mFreeSlots.empty()) {
+      slot = mFreeSlots.back();
+      mFreeSlots.pop_back();
+    } else {
+      slot = static_cast<u32>(mSlots.size());
+      mSlots.emplace_back();
+    }
+
+    mSlots[slot].dense = this->size();
+    mDenseToSlot.push_back(slot);
+    std::apply([&](auto &...fields) { (fields.push_back(values), ...); },
+               mFields);
+    return {slot, mSlots[slot].generation};
+  }
+
+  bool destroy(HandleType handle) {
+    if (!this->contains(handle)) {
+      return false;
+    }
+
+    u32 dense = mSlots[handle.index].dense;
+    u32 last = this->size() - 1;
+    if (dense != last) {
+      std::apply(
+          [&](auto &...fields) {
+            ((fields[dense] = std::move(fields[last])), ...);
+          },
+          mFields);
+      mDenseToSlot[dense] = mDenseToSlot[last];
+      mSlots[mDenseToSlot[dense]].dense = dense;
+    }
+
+    std::apply([](auto &...fields) { (fields.pop_back(), ...); }, mFields);
+    mDenseToSlot.pop_back();
+
+    mSlots[handle.index].dense = HandleType::INVALID_INDEX;
+    ++mSlots[handle.index].generation;
+    mFreeSlots.push_back(handle.index);
+    return true;
+  }
+
+  // Calls fn(handle, fields...) for every live entry in dense order.
+  template <typename Fn> void forEach(Fn &&fn) {
+    for (u32 i = 0; i < this->size(); ++i) {
+      std::apply(
+          [&](auto &...fields) { fn(this->getHandle(i), fields[i]...); },
+          mFields);
+    }
+  }
+
+  void clear() {
+    while (!this->empty()) {
+      this->destroy(this->getHandle(this->size() - 1));
+    }
+  }
+};
+
+} // namespace VulkanTutorial
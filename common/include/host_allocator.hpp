@@ -0,0 +1,99 @@
+#pragma once
+
+#include <common.hpp>
+
+namespace VulkanTutorial {
+
+static constexpr u32 ALLOCATION_SCOPE_COUNT =
+    VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+struct HostAllocationStats {
+  u64 currentBytes = 0;
+  u64 peakBytes = 0;
+  u64 allocationCount = 0;
+  u64 liveAllocations = 0;
+  // Allocated by the driver itself and only reported to us.
+  u64 internalBytes = 0;
+};
+
+// VkAllocationCallbacks backed by size-class pools. Small allocations are
+// served from per-thread free lists that refill from, and spill back to, a
+// shared pool in batches, so the driver rarely touches the global malloc.
+class HostAllocator {
+private:
+  struct ScopeCounters {
+    std::atomic<u64> currentBytes = 0;
+    std::atomic<u64> peakBytes = 0;
+    std::atomic<u64> allocationCount = 0;
+    std::atomic<u64> liveAllocations = 0;
+    std::atomic<u64> internalBytes = 0;
+  };
+
+  struct FreeNode {
+    FreeNode *next = nullptr;
+  };
+
+  static constexpr u32 SIZE_CLASS_COUNT = 8;
+  static constexpr array<size_t, SIZE_CLASS_COUNT> SIZE_CLASSES = {
+      32, 64, 128, 256, 512, 1024, 2048, 4096};
+  static constexpr size_t SLAB_SIZE = 64 * 1024;
+  static constexpr u32 CACHE_BATCH = 32;
+  static constexpr u32 CACHE_LIMIT = 4 * CACHE_BATCH;
+
+  struct ThreadCache {
+    array<FreeNode *, SIZE_CLASS_COUNT> heads{};
+    array<u32, SIZE_CLASS_COUNT> counts{};
+
+    ~ThreadCache();
+  };
+
+private:
+  VkAllocationCallbacks mCallbacks{};
+
+  std::mutex mMutex;
+  array<FreeNode *, SIZE_CLASS_COUNT> mFreeLists{};
+  vec<void *> mSlabs;
+
+  array<ScopeCounters, ALLOCATION_SCOPE_COUNT> mScopes;
+
+private:
+  HostAllocator();
+  ~HostAllocator();
+
+  static ThreadCache &getThreadCache();
+
+  void refill(ThreadCache &cache, u32 sizeClass);
+  void release(ThreadCache &cache, u32 sizeClass, u32 count);
+  void *allocateBlock(u32 sizeClass);
+  void freeBlock(void *block, u32 sizeClass);
+
+  void recordAllocation(VkSystemAllocationScope scope, u64 size);
+  void recordFree(VkSystemAllocationScope scope, u64 size);
+
+public:
+  HostAllocator(HostAllocator const &) = delete;
+  HostAllocator &operator=(HostAllocator const &) = delete;
+
+  static HostAllocator &get();
+
+  VkAllocationCallbacks const *getCallbacks() const { return &mCallbacks; }
+  HostAllocationStats getStats(VkSystemAllocationScope scope) const;
+  u64 getInternalBytes() const;
+  u64 getTotalBytes() const;
+
+  void *allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+  void *reallocate(void *original, size_t size, size_t alignment,
+                   VkSystemAllocationScope scope);
+  void free(void *memory);
+
+  void recordInternalAllocation(VkSystemAllocationScope scope, size_t size) {
+    mScopes[scope].internalBytes += size;
+  }
+  void recordInternalFree(VkSystemAllocationScope scope, size_t size) {
+    mScopes[scope].internalBytes -= size;
+  }
+
+  void log(std::ostream &stream) const;
+};
+
+} // namespace VulkanTutorial
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <common.hpp>
+
+namespace VulkanTutorial {
+
+struct ProcessMemoryUsage {
+  u64 residentBytes = 0;
+  u64 peakResidentBytes = 0;
+
+  bool isValid() const { return residentBytes > 0; }
+};
+
+// Breaks the process resident set down by subsystem. Each subsystem reports
+// the bytes it holds on the CPU side; whatever is left of the RSS is shown
+// as unattributed (code, libraries, the driver's own heaps). Peaks of
+// memory that has since been freed are listed apart and count toward the
+// peak RSS only.
+class MemoryReport {
+private:
+  map<str, u64> mSubsystems;
+  map<str, u64> mPeaks;
+  ProcessMemoryUsage mProcess{};
+
+public:
+  static ProcessMemoryUsage queryProcessUsage();
+
+  ProcessMemoryUsage const &getProcessUsage() const { return mProcess; }
+  u64 getSubsystemBytes(str const &subsystem) const;
+  u64 getAttributedBytes() const;
+
+  void set(str const &subsystem, u64 bytes) { mSubsystems[subsystem] = bytes; }
+  void add(str const &subsystem, u64 bytes) { mSubsystems[subsystem] += bytes; }
+  void setPeak(str const &subsystem, u64 bytes) { mPeaks[subsystem] = bytes; }
+  void capture() { mProcess = MemoryReport::queryProcessUsage(); }
+
+  void log(std::ostream &stream) const;
+};
+
+} // namespace VulkanTutorial
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <common.hpp>
+
+namespace VulkanTutorial {
+
+enum class MemoryCategory : u32 {
+  GEOMETRY = 0,
+  TEXTURE,
+  ATTACHMENT,
+  STAGING,
+  UNIFORM,
+  COUNT
+};
+
+static constexpr u32 MEMORY_CATEGORY_COUNT =
+    static_cast<u32>(MemoryCategory::COUNT);
+
+char const *toString(MemoryCategory category);
+
+struct MemoryHeapStatus {
+  VkDeviceSize size = 0;
+  VkDeviceSize budget = 0;
+  VkDeviceSize usage = 0;   // Process-wide usage reported by the driver
+  VkDeviceSize tracked = 0; // Allocations made through the tracker
+  bool deviceLocal = false;
+
+  VkDeviceSize headroom() const { return budget > usage ? budget - usage : 0; }
+};
+
+// Called with the heap index and the number of bytes that should be released
+// to get back under the warning threshold.
+using EvictionCallback = std::function<void(u32, VkDeviceSize)>;
+
+class MemoryTracker {
+private:
+  struct Allocation {
+    VkDeviceSize size = 0;
+    u32 heapIndex = 0;
+    MemoryCategory category = MemoryCategory::GEOMETRY;
+  };
+
+private:
+  VkPhysicalDevice mPhysicalDevice = VK_NULL_HANDLE;
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkAllocationCallbacks const *mAllocator = nullptr;
+  bool mBudgetSupported = false;
+
+  VkPhysicalDeviceMemoryProperties mMemoryProperties{};
+  array<MemoryHeapStatus, VK_MAX_MEMORY_HEAPS> mHeaps{};
+  array<VkDeviceSize, MEMORY_CATEGORY_COUNT> mCategoryTotals{};
+  umap<VkDeviceMemory, Allocation> mAllocations;
+
+  float mWarningThreshold = 0.9f;
+  EvictionCallback mEvictionCallback = nullptr;
+
+  std::chrono::steady_clock::duration mLogInterval = std::chrono::seconds(5);
+  std::chrono::steady_clock::time_point mLastLog{};
+
+private:
+  void queryBudget();
+  bool checkBudget(u32 heapIndex, VkDeviceSize incoming);
+
+public:
+  MemoryTracker() = default;
+  MemoryTracker(MemoryTracker const &) = delete;
+  MemoryTracker &operator=(MemoryTracker const &) = delete;
+
+  VkAllocationCallbacks const *getAllocator() const { return mAllocator; }
+  bool isBudgetSupported() const { return mBudgetSupported; }
+  u32 getHeapCount() const { return mMemoryProperties.memoryHeapCount; }
+  MemoryHeapStatus const &getHeapStatus(u32 heapIndex) const {
+    return mHeaps[heapIndex];
+  }
+  VkDeviceSize getHeapHeadroom(u32 heapIndex) const {
+    return mHeaps[heapIndex].headroom();
+  }
+  VkDeviceSize getCategoryTotal(MemoryCategory category) const {
+    return mCategoryTotals[static_cast<u32>(category)];
+  }
+  VkDeviceSize getTotalTracked() const;
+
+  void setWarningThreshold(float threshold) { mWarningThreshold = threshold; }
+  void setEvictionCallback(EvictionCallback const &callback) {
+    mEvictionCallback = callback;
+  }
+  void setLogInterval(std::chrono::steady_clock::duration interval) {
+    mLogInterval = interval;
+  }
+
+  void init(VkPhysicalDevice physicalDevice, VkDevice device,
+            bool budgetSupported,
+            VkAllocationCallbacks const *allocator = nullptr);
+
+  VkResult allocate(VkMemoryAllocateInfo const &allocInfo,
+                    MemoryCategory category, VkDeviceMemory *memory);
+  void free(VkDeviceMemory memory);
+
+  void update();
+  void tick();
+  void log(std::ostream &stream);
+};
+
+} // namespace VulkanTutorial
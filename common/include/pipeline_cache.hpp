@@ -0,0 +1,72 @@
+#pragma once
+
+#include <common.hpp>
+
+namespace VulkanTutorial {
+
+static constexpr char const *PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+// VkPipelineCache persisted across runs. The file holds the driver's cache
+// data plus how long each program took to create its pipelines on a cold
+// start, so a warm start can report what the cache saved. All programs
+// share one file: every run loads the entries written by the others and
+// writes them back together with its own.
+//
+// Data from another driver, device or cache version is rejected by checking
+// the header against the physical device. The file is written to a
+// temporary path and renamed, so a crash never leaves a torn cache behind.
+class PipelineCache {
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Baseline {
+    str program;
+    Clock::duration creationTime{};
+  };
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkAllocationCallbacks const *mAllocator = nullptr;
+  VkPipelineCache mCache = VK_NULL_HANDLE;
+  str mPath;
+  str mProgram;
+
+  vec<Baseline> mBaselines;
+  u64 mLoadedSize = 0;
+  // Set when this program's pipelines were already in the loaded data.
+  bool mWarm = false;
+  // Pipelines may be created from several threads at once.
+  mutable std::mutex mMutex;
+  Clock::duration mCreationTime{};
+  u32 mPipelineCount = 0;
+
+private:
+  vec<char> load(VkPhysicalDevice physicalDevice);
+  void save() const;
+
+public:
+  PipelineCache() = default;
+  PipelineCache(PipelineCache const &) = delete;
+  PipelineCache &operator=(PipelineCache const &) = delete;
+
+  VkPipelineCache getCache() const { return mCache; }
+  bool isWarm() const { return mWarm; }
+
+  // program names the executable, keying its cold start baseline.
+  void init(VkPhysicalDevice physicalDevice, VkDevice device,
+            VkAllocationCallbacks const *allocator, str const &program,
+            str const &path = PIPELINE_CACHE_PATH);
+  // Writes the cache back to disk before destroying it.
+  void destroy();
+
+  VkResult createGraphicsPipeline(VkGraphicsPipelineCreateInfo const &info,
+                                  VkAllocationCallbacks const *allocator,
+                                  VkPipeline *pipeline);
+  VkResult createComputePipeline(VkComputePipelineCreateInfo const &info,
+                                 VkAllocationCallbacks const *allocator,
+                                 VkPipeline *pipeline);
+
+  void log(std::ostream &stream) const;
+};
+
+} // namespace VulkanTutorial
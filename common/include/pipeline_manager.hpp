@@ -0,0 +1,121 @@
+#pragma once
+
+#include <common.hpp>
+
+#include <deque>
+
+namespace VulkanTutorial {
+
+// The fixed-function state a graphics pipeline permutation is built from,
+// packed into eight bytes so it hashes and compares as one integer.
+struct PipelineKey {
+  static constexpr u8 DEPTH_TEST_BIT = 0x1;
+  static constexpr u8 DEPTH_WRITE_BIT = 0x2;
+  static constexpr u8 BLEND_BIT = 0x4;
+
+  u8 samples = VK_SAMPLE_COUNT_1_BIT;
+  u8 cullMode = VK_CULL_MODE_BACK_BIT;
+  u8 frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  u8 topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  u8 depthCompareOp = VK_COMPARE_OP_LESS;
+  u8 flags = DEPTH_TEST_BIT | DEPTH_WRITE_BIT;
+  // Specialization constant toggles; their meaning is up to the shaders.
+  u16 features = 0;
+
+  bool hasFlag(u8 flag) const { return (flags & flag) != 0; }
+  void setFlag(u8 flag, bool enabled) {
+    flags = static_cast<u8>(enabled ? flags | flag : flags & ~flag);
+  }
+
+  u64 pack() const;
+  bool operator==(PipelineKey const &other) const {
+    return this->pack() == other.pack();
+  }
+};
+
+// What the pipelines render into. It lives in the manager so the compile
+// threads never read state the render thread may be rewriting.
+struct PipelineTarget {
+  // Null when rendering dynamically.
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+  VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+};
+
+using PipelineBuilder = std::function<VkPipeline(
+    PipelineKey const &key, PipelineTarget const &target)>;
+
+// Compiles graphics pipeline permutations on demand and keeps them for the
+// lifetime of the manager. get() never blocks: a permutation that is not
+// ready yet is queued for the compile threads and the caller draws with a
+// fallback in the meantime, so a new state combination costs a frame or two
+// of the old look instead of a hitch. require() compiles on the calling
+// thread and is meant for the fallback itself.
+//
+// The builder runs on the compile threads and must be safe to call
+// concurrently. Every request is built against the target current when it
+// was made. A permutation the builder throws for is logged and stays on the
+// fallback; require() rethrows the exception of its own key.
+class PipelineManager {
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    bool ready = false;
+    // Set when the builder threw for this key.
+    std::exception_ptr error;
+  };
+
+  struct Job {
+    PipelineKey key;
+    PipelineTarget target;
+  };
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkAllocationCallbacks const *mAllocator = nullptr;
+  PipelineBuilder mBuilder;
+  vec<std::thread> mThreads;
+
+  std::mutex mMutex;
+  std::condition_variable mWorkReady;
+  std::condition_variable mCompiled;
+  // An entry exists from the first request on; ready once compiled.
+  umap<u64, Entry> mEntries;
+  PipelineTarget mTarget;
+  std::deque<Job> mPending;
+  bool mStopping = false;
+
+  u64 mBackgroundCompiles = 0;
+  u64 mFallbackRequests = 0;
+  Clock::duration mCompileTime{};
+
+private:
+  void compileLoop();
+  std::exception_ptr compile(Job const &job);
+
+public:
+  PipelineManager() = default;
+  PipelineManager(PipelineManager const &) = delete;
+  PipelineManager &operator=(PipelineManager const &) = delete;
+
+  void init(VkDevice device, VkAllocationCallbacks const *allocator,
+            u32 threadCount, PipelineTarget const &target,
+            PipelineBuilder builder);
+  // Destroys every pipeline; the device must no longer be using them.
+  void destroy();
+
+  // Applies to permutations requested from now on; compiled ones are kept.
+  void setTarget(PipelineTarget const &target);
+
+  bool isReady(PipelineKey const &key);
+  VkPipeline require(PipelineKey const &key);
+  // fallback must have been passed to require() before.
+  VkPipeline get(PipelineKey const &key, PipelineKey const &fallback);
+  void prefetch(PipelineKey const &key);
+
+  void log(std::ostream &stream);
+};
+
+} // namespace VulkanTutorial
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <common.hpp>
+
+#include <deque>
+
+namespace VulkanTutorial {
+
+struct PresentRequest {
+  VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+  u32 imageIndex = 0;
+  VkSemaphore waitSemaphore = VK_NULL_HANDLE;
+};
+
+// Calls vkQueuePresentKHR for the render thread. When threaded, push()
+// queues the request and returns at once, so a present that blocks on the
+// window system no longer holds up recording the next frame. Otherwise the
+// image is presented inline. Either way, out of date and suboptimal results
+// come back through poll().
+//
+// The present queue and the swapchain must be externally synchronized, so
+// anything else touching them (acquiring an image, submitting to a queue
+// shared with presentation) holds lockQueue(). drain() must be called
+// before the swapchain is recreated or destroyed.
+class PresentThread {
+private:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  VkQueue mQueue = VK_NULL_HANDLE;
+  std::thread mThread;
+  std::mutex mQueueMutex;
+
+  std::mutex mMutex;
+  std::condition_variable mWorkReady;
+  std::condition_variable mIdle;
+  std::deque<PresentRequest> mPending;
+  bool mPresenting = false;
+  bool mStopping = false;
+  // Most severe result since the last poll().
+  VkResult mResult = VK_SUCCESS;
+
+  u64 mPresents = 0;
+  Clock::duration mBlocked{};
+
+private:
+  void present(PresentRequest const &request);
+  void presentLoop();
+
+public:
+  PresentThread() = default;
+  PresentThread(PresentThread const &) = delete;
+  PresentThread &operator=(PresentThread const &) = delete;
+  ~PresentThread() { this->destroy(); }
+
+  bool isThreaded() const { return mThread.joinable(); }
+
+  void init(VkQueue queue, bool threaded);
+  void destroy();
+
+  std::unique_lock<std::mutex> lockQueue() {
+    return std::unique_lock<std::mutex>(mQueueMutex);
+  }
+
+  void push(PresentRequest const &request);
+  // Returns true if a present since the last call reported the swapchain
+  // as out of date or suboptimal. Other errors are thrown.
+  bool poll();
+  // Waits until every queued request has been presented.
+  void drain();
+
+  void log(std::ostream &stream);
+};
+
+} // namespace VulkanTutorial
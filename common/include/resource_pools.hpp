@@ -0,0 +1,64 @@
+#pragma once
+
+#include <block_allocator.hpp>
+#include <common.hpp>
+#include <handle_pool.hpp>
+
+namespace VulkanTutorial {
+
+using BufferHandle = Handle<struct BufferTag>;
+using ImageHandle = Handle<struct ImageTag>;
+using MeshHandle = Handle<struct MeshTag>;
+using TextureHandle = Handle<struct TextureTag>;
+
+class BufferPool : public HandlePool<struct BufferTag, VkBuffer,
+                                     MemoryAllocation, VkDeviceSize> {
+public:
+  VkBuffer &getBuffer(BufferHandle handle) { return this->get<0>(handle); }
+  MemoryAllocation &getAllocation(BufferHandle handle) {
+    return this->get<1>(handle);
+  }
+  VkDeviceSize getSize(BufferHandle handle) const {
+    return this->get<2>(handle);
+  }
+};
+
+class ImagePool
+    : public HandlePool<struct ImageTag, VkImage, VkImageView,
+                        MemoryAllocation, VkExtent2D, u32> {
+public:
+  VkImage &getImage(ImageHandle handle) { return this->get<0>(handle); }
+  VkImageView &getView(ImageHandle handle) { return this->get<1>(handle); }
+  MemoryAllocation &getAllocation(ImageHandle handle) {
+    return this->get<2>(handle);
+  }
+  VkExtent2D getExtent(ImageHandle handle) const {
+    return this->get<3>(handle);
+  }
+  u32 getMipLevels(ImageHandle handle) const { return this->get<4>(handle); }
+};
+
+class MeshPool : public HandlePool<struct MeshTag, BufferHandle, BufferHandle,
+                                   u32, glm::vec4> {
+public:
+  BufferHandle getVertexBuffer(MeshHandle handle) const {
+    return this->get<0>(handle);
+  }
+  BufferHandle getIndexBuffer(MeshHandle handle) const {
+    return this->get<1>(handle);
+  }
+  u32 getIndexCount(MeshHandle handle) const { return this->get<2>(handle); }
+  // Model-space bounding sphere: center in xyz, radius in w.
+  glm::vec4 getBounds(MeshHandle handle) const { return this->get<3>(handle); }
+};
+
+class TexturePool
+    : public HandlePool<struct TextureTag, ImageHandle, VkSampler> {
+public:
+  ImageHandle getImage(TextureHandle handle) const {
+    return this->get<0>(handle);
+  }
+  VkSampler &getSampler(TextureHandle handle) { return this->get<1>(handle); }
+};
+
+} // namespace VulkanTutorial
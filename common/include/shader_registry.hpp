@@ -0,0 +1,35 @@
+#pragma once
+
+#include <common.hpp>
+
+namespace VulkanTutorial {
+
+struct ShaderCode {
+  u32 const *code = nullptr;
+  size_t size = 0; // In bytes, as VkShaderModuleCreateInfo::codeSize wants
+};
+
+// SPIR-V modules compiled into the executable, looked up by name, e.g.
+// "chapter4/shader.vert". Each module is embedded at build time by
+// embed_shaders() in cmake/shaders.cmake, whose generated sources add()
+// themselves during static initialization. Nothing is read from disk: a
+// name that was not embedded is a build problem and find() throws.
+class ShaderRegistry {
+private:
+  std::mutex mMutex;
+  umap<str, ShaderCode> mShaders;
+
+private:
+  ShaderRegistry() = default;
+
+public:
+  ShaderRegistry(ShaderRegistry const &) = delete;
+  ShaderRegistry &operator=(ShaderRegistry const &) = delete;
+
+  static ShaderRegistry &get();
+
+  bool add(char const *name, u32 const *code, size_t size);
+  ShaderCode find(str const &name);
+};
+
+} // namespace VulkanTutorial
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <common.hpp>
+
+namespace VulkanTutorial {
+
+// Collects the queue work of every subsystem during a frame and submits it
+// with one call per queue (and fence) on flush(), each logical submission
+// becoming one batch of that call. A batch ends once something is signaled,
+// so a later wait never delays work recorded before it, and signals are
+// never held back by work queued after them.
+//
+// Stages are VkPipelineStageFlags2 and go to vkQueueSubmit2 when
+// synchronization2 is enabled; otherwise they are narrowed to the legacy
+// flags and sent through vkQueueSubmit. Calls are flushed in the order they
+// were opened. A wait on a semaphore that a queued call signals opens a new
+// call for its queue behind that one, so a binary semaphore is signaled
+// before it is waited on whenever its signal was queued first.
+class SubmitScheduler {
+private:
+  struct Batch {
+    vec<VkSemaphoreSubmitInfo> waits;
+    vec<VkCommandBufferSubmitInfo> commandBuffers;
+    vec<VkSemaphoreSubmitInfo> signals;
+  };
+
+  struct Call {
+    VkQueue queue = VK_NULL_HANDLE;
+    vec<Batch> batches;
+    VkFence fence = VK_NULL_HANDLE;
+  };
+
+private:
+  bool mUseSynchronization2 = false;
+  // In submission order. Work for a queue goes into its last call unless
+  // that call is fenced or has to follow a signal queued after it.
+  vec<Call> mCalls;
+
+  u64 mSubmitCalls = 0;
+  u64 mBatches = 0;
+
+private:
+  // first is the lowest index the call may have.
+  Call &getCall(VkQueue queue, size_t first = 0);
+  Batch &getBatch(VkQueue queue, bool forWait, size_t first = 0);
+  size_t findCallAfterSignal(VkSemaphore semaphore) const;
+  void submitLegacy(Call const &call);
+  void submit2(Call const &call);
+
+public:
+  SubmitScheduler() = default;
+  SubmitScheduler(SubmitScheduler const &) = delete;
+  SubmitScheduler &operator=(SubmitScheduler const &) = delete;
+
+  bool usesSynchronization2() const { return mUseSynchronization2; }
+  bool isEmpty() const { return mCalls.empty(); }
+  u64 getSubmitCalls() const { return mSubmitCalls; }
+  u64 getBatches() const { return mBatches; }
+
+  void init(bool useSynchronization2);
+
+  // value is only used for timeline semaphores.
+  void wait(VkQueue queue, VkSemaphore semaphore, VkPipelineStageFlags2 stages,
+            u64 value = 0);
+  void add(VkQueue queue, VkCommandBuffer commandBuffer);
+  void signal(VkQueue queue, VkSemaphore semaphore,
+              VkPipelineStageFlags2 stages, u64 value = 0);
+  // Signals once everything queued so far on queue has completed. Work
+  // queued afterwards goes into the next call.
+  void fence(VkQueue queue, VkFence fence);
+
+  void flush();
+
+  void log(std::ostream &stream) const;
+};
+
+} // namespace VulkanTutorial
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <common.hpp>
+
+namespace VulkanTutorial {
+
+// Lock-free handoff of the latest value from one producer thread to one
+// consumer thread. The producer always owns a slot to fill and the consumer
+// always owns a slot to read; the third slot holds the most recently
+// published value. publish() and acquire() are a single atomic exchange each,
+// so neither side ever waits for the other. A slow consumer skips values
+// instead of queueing them.
+template <typename T> class TripleBuffer {
+private:
+  static constexpr u32 INDEX_MASK = 0x3;
+  static constexpr u32 FRESH_BIT = 0x4;
+
+private:
+  array<T, 3> mSlots{};
+  // Index of the shared slot, plus FRESH_BIT while it holds a value the
+  // consumer has not taken yet.
+  alignas(64) std::atomic<u32> mShared{1};
+  alignas(64) u32 mWriteIndex = 0;
+  alignas(64) u32 mReadIndex = 2;
+
+public:
+  TripleBuffer() = default;
+  TripleBuffer(TripleBuffer const &) = delete;
+  TripleBuffer &operator=(TripleBuffer const &) = delete;
+
+  // Producer side. The slot keeps whatever was last written to it, so
+  // containers can be cleared and refilled without reallocating.
+  T &getWriteBuffer() { return mSlots[mWriteIndex]; }
+  void publish() {
+    u32 previous = mShared.exchange(mWriteIndex | FRESH_BIT,
+                                    std::memory_order_acq_rel);
+    mWriteIndex = previous & INDEX_MASK;
+  }
+
+  // Consumer side. Returns true if a newer value was taken; the read buffer
+  // stays valid and unchanged until the next successful acquire().
+  bool acquire() {
+    if (!(mShared.load(std::memory_order_relaxed) & FRESH_BIT)) {
+      return false;
+    }
+    u32 previous = mShared.exchange(mReadIndex, std::memory_order_acq_rel);
+    mReadIndex = previous & INDEX_MASK;
+    return true;
+  }
+  T const &getReadBuffer() const { return mSlots[mReadIndex]; }
+};
+
+} // namespace VulkanTutorial
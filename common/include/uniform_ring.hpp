@@ -0,0 +1,57 @@
+#pragma once
+
+#include <common.hpp>
+#include <memory_tracker.hpp>
+
+namespace VulkanTutorial {
+
+struct UniformAllocation {
+  u32 offset = 0; // Dynamic offset to pass to vkCmdBindDescriptorSets
+  void *data = nullptr;
+};
+
+// One persistently mapped uniform buffer split into a region per frame in
+// flight. Each region is bump-allocated and reset when its frame comes
+// around again, so per-object uniform data never needs its own buffer.
+class UniformRing {
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  MemoryTracker *mTracker = nullptr;
+
+  VkBuffer mBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory mMemory = VK_NULL_HANDLE;
+  u8 *mMapped = nullptr;
+
+  VkDeviceSize mAlignment = 1;
+  VkDeviceSize mFrameSize = 0;
+  u32 mFrameCount = 0;
+
+  VkDeviceSize mFrameBegin = 0;
+  VkDeviceSize mHead = 0;
+  VkDeviceSize mPeakUsage = 0;
+
+public:
+  UniformRing() = default;
+  UniformRing(UniformRing const &) = delete;
+  UniformRing &operator=(UniformRing const &) = delete;
+
+  VkBuffer getBuffer() const { return mBuffer; }
+  VkDeviceSize getAlignment() const { return mAlignment; }
+  VkDeviceSize getFrameSize() const { return mFrameSize; }
+  VkDeviceSize getPeakUsage() const { return mPeakUsage; }
+
+  void init(VkPhysicalDevice physicalDevice, VkDevice device,
+            MemoryTracker *tracker, VkDeviceSize frameSize, u32 frameCount);
+  void destroy();
+
+  void beginFrame(u32 frameIndex);
+  UniformAllocation allocate(VkDeviceSize size);
+
+  template <typename T> u32 push(T const &value) {
+    UniformAllocation allocation = this->allocate(sizeof(T));
+    std::memcpy(allocation.data, &value, sizeof(T));
+    return allocation.offset;
+  }
+};
+
+} // namespace VulkanTutorial
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <common.hpp>
+#include <deletion_queue.hpp>
+#include <submit_scheduler.hpp>
+
+namespace VulkanTutorial {
+
+struct UploadQueue {
+  VkQueue queue = VK_NULL_HANDLE;
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+  u32 family = 0;
+};
+
+// Value of the batch's graphics submission on the deletion queue timeline.
+struct UploadToken {
+  u64 submission = 0;
+
+  bool isValid() const { return submission != 0; }
+};
+
+struct UploadStats {
+  u64 operations = 0;  // Each used to be its own submit and queue wait
+  u64 submissions = 0; // Submission batches actually queued
+  u64 waits = 0;       // Explicit waits on an upload token
+
+  u64 getSavedSubmissions() const {
+    return operations > submissions ? operations - submissions : 0;
+  }
+  u64 getSavedWaits() const {
+    return operations > waits ? operations - waits : 0;
+  }
+};
+
+// Collects copies, layout transitions and mip generation and records them all
+// at submit time: one merged barrier before the copies, the copies, one
+// merged barrier after, then the graphics-only work. With a dedicated
+// transfer queue the copies go there and the graphics part acquires the
+// resources after waiting on a semaphore; otherwise everything shares one
+// command buffer. Either way the batch ends in a single graphics submission
+// that signals the deletion queue's timeline, or a fence without one. The
+// submissions are queued on a SubmitScheduler and go out with its next
+// flush.
+class UploadBatch {
+private:
+  struct BufferCopy {
+    VkBuffer src = VK_NULL_HANDLE;
+    VkBuffer dst = VK_NULL_HANDLE;
+    VkBufferCopy region{};
+  };
+
+  struct ImageCopy {
+    VkBuffer src = VK_NULL_HANDLE;
+    VkImage dst = VK_NULL_HANDLE;
+    VkBufferImageCopy region{};
+  };
+
+  struct MipChain {
+    VkImage image = VK_NULL_HANDLE;
+    VkExtent2D extent{};
+    u32 mipLevels = 1;
+  };
+
+  struct BarrierBatch {
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    vec<VkBufferMemoryBarrier> buffers;
+    vec<VkImageMemoryBarrier> images;
+
+    bool empty() const { return buffers.empty() && images.empty(); }
+    void record(VkCommandBuffer commandBuffer) const;
+    void clear();
+  };
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkAllocationCallbacks const *mAllocator = nullptr;
+  DeletionQueue *mDeletionQueue = nullptr;
+  SubmitScheduler *mScheduler = nullptr;
+  UploadQueue mGraphics{};
+  UploadQueue mTransfer{};
+  bool mDedicatedTransfer = false;
+
+  BarrierBatch mPreCopy;
+  vec<BufferCopy> mBufferCopies;
+  vec<ImageCopy> mImageCopies;
+  BarrierBatch mPostCopy; // Release barriers with a dedicated transfer queue
+  BarrierBatch mAcquire;  // Acquire barriers and graphics-side transitions
+  vec<MipChain> mMipChains;
+  vec<DeletionCallback> mCleanup;
+  u32 mOperations = 0;
+
+  UploadStats mStats{};
+
+private:
+  VkCommandBuffer beginCommands(UploadQueue const &queue);
+  void recordMipChain(VkCommandBuffer commandBuffer, MipChain const &chain);
+  void handOver(VkBufferMemoryBarrier barrier, VkPipelineStageFlags dstStage);
+  void handOver(VkImageMemoryBarrier barrier, VkPipelineStageFlags dstStage);
+  void clear();
+
+public:
+  UploadBatch() = default;
+  UploadBatch(UploadBatch const &) = delete;
+  UploadBatch &operator=(UploadBatch const &) = delete;
+
+  bool isEmpty() const { return mOperations == 0; }
+  bool hasDedicatedTransfer() const { return mDedicatedTransfer; }
+  UploadStats const &getStats() const { return mStats; }
+
+  void init(VkDevice device, VkAllocationCallbacks const *allocator,
+            DeletionQueue *deletionQueue, SubmitScheduler *scheduler,
+            UploadQueue const &graphics, UploadQueue const &transfer);
+
+  void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size,
+                  VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+  // Leaves every level in TRANSFER_DST_OPTIMAL, owned by the graphics queue,
+  // ready for generateMipmaps.
+  void copyBufferToImage(VkBuffer buffer, VkImage image, VkExtent2D extent,
+                         u32 mipLevels);
+  void transitionImage(VkImageMemoryBarrier const &barrier,
+                       VkPipelineStageFlags srcStage,
+                       VkPipelineStageFlags dstStage);
+  // Leaves every level in SHADER_READ_ONLY_OPTIMAL.
+  void generateMipmaps(VkImage image, VkExtent2D extent, u32 mipLevels);
+  void retire(DeletionCallback const &destroy);
+
+  UploadToken submit();
+  bool isComplete(UploadToken const &token) const;
+  void wait(UploadToken const &token);
+  void discard();
+
+  void log(std::ostream &stream) const;
+};
+
+} // namespace VulkanTutorial
@@ -9,4 +9,14 @@ VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
     VkDebugUtilsMessengerCallbackDataEXT const *pCallbackData, void *pUserData);
 
 vec<char> readFile(str const &filename);
+
+bool isDeviceExtensionSupported(VkPhysicalDevice device,
+                                char const *extensionName);
+bool isTimelineSemaphoreSupported(VkPhysicalDevice device);
+bool isSynchronization2Supported(VkPhysicalDevice device);
+bool isDynamicRenderingSupported(VkPhysicalDevice device);
+bool isExtendedDynamicStateSupported(VkPhysicalDevice device);
+bool isDynamicColorBlendEnableSupported(VkPhysicalDevice device);
+u32 findMemoryType(VkPhysicalDevice physicalDevice, u32 typeFilter,
+                   VkMemoryPropertyFlags properties);
 } // namespace VulkanTutorial::Util
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <common.hpp>
+
+namespace VulkanTutorial {
+
+using WorkerTask = std::function<void(u32 task)>;
+
+// Fixed set of threads for fork-join work. run() hands task i to worker i
+// and returns once every task has finished, so a task can own per-worker
+// state such as a command pool without further locking. The first exception
+// thrown by a task is rethrown from run().
+class WorkerPool {
+private:
+  vec<std::thread> mThreads;
+
+  std::mutex mMutex;
+  std::condition_variable mWorkReady;
+  std::condition_variable mWorkDone;
+  WorkerTask const *mTask = nullptr;
+  u32 mTaskCount = 0;
+  u32 mRemaining = 0;
+  u64 mGeneration = 0;
+  bool mStopping = false;
+  std::exception_ptr mError;
+
+private:
+  void workerLoop(u32 index);
+
+public:
+  WorkerPool() = default;
+  WorkerPool(WorkerPool const &) = delete;
+  WorkerPool &operator=(WorkerPool const &) = delete;
+  ~WorkerPool() { this->destroy(); }
+
+  u32 getThreadCount() const { return static_cast<u32>(mThreads.size()); }
+
+  void init(u32 threadCount);
+  void destroy();
+
+  void run(u32 taskCount, WorkerTask const &task);
+};
+
+} // namespace VulkanTutorial
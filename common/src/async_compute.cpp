@@ -0,0 +1,213 @@
+#include <async_compute.hpp>
+
+namespace VulkanTutorial {
+
+namespace {
+u32 getTimestampValidBits(VkPhysicalDevice physicalDevice, u32 family) {
+  u32 count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, nullptr);
+  vec<VkQueueFamilyProperties> families(count);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count,
+                                           families.data());
+  return family < count ? families[family].timestampValidBits : 0;
+}
+} // namespace
+
+void AsyncCompute::init(VkPhysicalDevice physicalDevice, VkDevice device,
+                        VkAllocationCallbacks const *allocator,
+                        SubmitScheduler *scheduler, VkQueue queue, u32 family,
+                        u32 graphicsFamily, u32 frameCount) {
+  mDevice = device;
+  mAllocator = allocator;
+  mScheduler = scheduler;
+  mQueue = queue;
+  mFamily = family;
+  mDedicated = family != graphicsFamily;
+
+  mCommandPools.init(mDevice, mAllocator, mFamily, frameCount, 1);
+  mCommandBuffers.assign(frameCount, VK_NULL_HANDLE);
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  mSemaphores.assign(frameCount, VK_NULL_HANDLE);
+  for (auto &semaphore : mSemaphores) {
+    if (vkCreateSemaphore(mDevice, &semaphoreInfo, mAllocator, &semaphore) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("Failed to create compute semaphore.");
+    }
+  }
+
+  mPendingQueries.assign(frameCount, false);
+  mPreviousGraphics = {};
+  mLastLog = Clock::now();
+  this->resetWindow();
+
+  u32 computeBits = getTimestampValidBits(physicalDevice, family);
+  u32 graphicsBits = getTimestampValidBits(physicalDevice, graphicsFamily);
+  if (computeBits == 0 || graphicsBits == 0) {
+    return;
+  }
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  mTimestampPeriod = properties.limits.timestampPeriod;
+  u32 validBits = std::min(computeBits, graphicsBits);
+  mTimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+  VkQueryPoolCreateInfo queryInfo{};
+  queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  queryInfo.queryCount = frameCount * QUERIES_PER_FRAME;
+
+  if (vkCreateQueryPool(mDevice, &queryInfo, mAllocator, &mQueryPool) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create timestamp query pool.");
+  }
+}
+
+void AsyncCompute::destroy() {
+  if (mQueryPool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(mDevice, mQueryPool, mAllocator);
+    mQueryPool = VK_NULL_HANDLE;
+  }
+  for (VkSemaphore semaphore : mSemaphores) {
+    vkDestroySemaphore(mDevice, semaphore, mAllocator);
+  }
+  mSemaphores.clear();
+  mCommandBuffers.clear();
+  mCommandPools.destroy();
+}
+
+void AsyncCompute::resetWindow() {
+  mComputeTotal = 0.0;
+  mOverlapTotal = 0.0;
+  mSamples = 0;
+}
+
+VkCommandBuffer AsyncCompute::begin(u32 frame) {
+  mCommandPools.beginFrame(frame);
+  VkCommandBuffer commandBuffer = mCommandPools.acquire(0);
+  mCommandBuffers[frame] = commandBuffer;
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to begin compute recording.");
+  }
+
+  if (mQueryPool != VK_NULL_HANDLE) {
+    u32 query = frame * QUERIES_PER_FRAME;
+    vkCmdResetQueryPool(commandBuffer, mQueryPool, query, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        mQueryPool, query);
+  }
+  return commandBuffer;
+}
+
+VkSemaphore AsyncCompute::submit(u32 frame) {
+  VkCommandBuffer commandBuffer = mCommandBuffers[frame];
+  if (mQueryPool != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        mQueryPool, frame * QUERIES_PER_FRAME + 1);
+  }
+
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to record compute command buffer.");
+  }
+
+  mScheduler->add(mQueue, commandBuffer);
+  mScheduler->signal(mQueue, mSemaphores[frame],
+                     VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+
+  mPendingQueries[frame] = mQueryPool != VK_NULL_HANDLE;
+  return mSemaphores[frame];
+}
+
+void AsyncCompute::beginGraphics(VkCommandBuffer commandBuffer,
+                                 u32 frame) const {
+  if (mQueryPool == VK_NULL_HANDLE) {
+    return;
+  }
+
+  // The graphics queue may start before the compute semaphore is waited on,
+  // so it resets its own queries.
+  u32 query = frame * QUERIES_PER_FRAME + 2;
+  vkCmdResetQueryPool(commandBuffer, mQueryPool, query, 2);
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      mQueryPool, query);
+}
+
+void AsyncCompute::endGraphics(VkCommandBuffer commandBuffer,
+                               u32 frame) const {
+  if (mQueryPool == VK_NULL_HANDLE) {
+    return;
+  }
+
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      mQueryPool, frame * QUERIES_PER_FRAME + 3);
+}
+
+void AsyncCompute::update(u32 frame) {
+  if (!mPendingQueries[frame]) {
+    return;
+  }
+
+  array<u64, QUERIES_PER_FRAME> values{};
+  if (vkGetQueryPoolResults(mDevice, mQueryPool, frame * QUERIES_PER_FRAME,
+                            QUERIES_PER_FRAME, sizeof(values), values.data(),
+                            sizeof(u64),
+                            VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+    return;
+  }
+  mPendingQueries[frame] = false;
+
+  Interval compute{values[0] & mTimestampMask, values[1] & mTimestampMask};
+  Interval graphics{values[2] & mTimestampMask, values[3] & mTimestampMask};
+
+  // Frames complete in order, so mPreviousGraphics is the frame before.
+  u64 overlapBegin = std::max(compute.begin, mPreviousGraphics.begin);
+  u64 overlapEnd = std::min(compute.end, mPreviousGraphics.end);
+  u64 overlap = overlapEnd > overlapBegin ? overlapEnd - overlapBegin : 0;
+
+  mComputeTotal +=
+      static_cast<double>(compute.end - compute.begin) * mTimestampPeriod;
+  mOverlapTotal += static_cast<double>(overlap) * mTimestampPeriod;
+  ++mSamples;
+  mPreviousGraphics = graphics;
+}
+
+void AsyncCompute::tick() {
+  if (mLogInterval.count() <= 0) {
+    return;
+  }
+
+  auto now = Clock::now();
+  if (now - mLastLog < mLogInterval) {
+    return;
+  }
+  mLastLog = now;
+
+  this->log(std::cout);
+  this->resetWindow();
+}
+
+void AsyncCompute::log(std::ostream &stream) const {
+  stream << std::fixed << std::setprecision(3) << "[Compute] "
+         << (mDedicated ? "dedicated queue:" : "graphics queue:");
+  if (mSamples == 0) {
+    stream << " no timed frames" << std::defaultfloat << std::endl;
+    return;
+  }
+
+  double compute = mComputeTotal / static_cast<double>(mSamples) / 1e6;
+  double overlap = mOverlapTotal / static_cast<double>(mSamples) / 1e6;
+  double share = mComputeTotal > 0.0 ? mOverlapTotal / mComputeTotal : 0.0;
+  stream << " avg " << compute << " ms, " << overlap
+         << " ms overlapped with the previous frame's graphics ("
+         << std::setprecision(1) << share * 100.0 << "%) over " << mSamples
+         << " frames" << std::defaultfloat << std::endl;
+}
+
+} // namespace VulkanTutorial
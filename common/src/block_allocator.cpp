@@ -0,0 +1,174 @@
+#include <block_allocator.hpp>
+
+namespace VulkanTutorial {
+
+namespace {
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return alignment ? (value + alignment - 1) / alignment * alignment : value;
+}
+} // namespace
+
+bool BlockAllocator::tryAllocate(u32 blockId, Block &block,
+                                 VkMemoryRequirements const &requirements,
+                                 u64 userData, MemoryAllocation &allocation) {
+  for (auto it = block.freeRanges.begin(); it != block.freeRanges.end();
+       ++it) {
+    VkDeviceSize rangeOffset = it->first;
+    VkDeviceSize rangeEnd = it->first + it->second;
+    VkDeviceSize offset = alignUp(rangeOffset, requirements.alignment);
+    if (offset + requirements.size > rangeEnd) {
+      continue;
+    }
+
+    block.freeRanges.erase(it);
+    if (offset > rangeOffset) {
+      block.freeRanges[rangeOffset] = offset - rangeOffset;
+    }
+    if (offset + requirements.size < rangeEnd) {
+      block.freeRanges[offset + requirements.size] =
+          rangeEnd - offset - requirements.size;
+    }
+
+    block.allocations[offset] = {requirements.size, userData};
+    block.used += requirements.size;
+
+    allocation.memory = block.memory;
+    allocation.offset = offset;
+    allocation.size = requirements.size;
+    allocation.blockId = blockId;
+    return true;
+  }
+
+  return false;
+}
+
+u32 BlockAllocator::createBlock(VkDeviceSize size, u32 memoryTypeIndex,
+                                MemoryCategory category) {
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+  Block block{};
+  if (mTracker->allocate(allocInfo, category, &block.memory) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate memory block.");
+  }
+  block.size = size;
+  block.memoryTypeIndex = memoryTypeIndex;
+  block.category = category;
+  block.freeRanges[0] = size;
+
+  u32 id = mNextBlockId++;
+  mBlocks[id] = std::move(block);
+  return id;
+}
+
+void BlockAllocator::init(MemoryTracker *tracker, VkDeviceSize blockSize) {
+  mTracker = tracker;
+  mBlockSize = blockSize;
+}
+
+void BlockAllocator::destroy() {
+  for (auto &[id, block] : mBlocks) {
+    mTracker->free(block.memory);
+  }
+  mBlocks.clear();
+}
+
+MemoryAllocation BlockAllocator::allocate(
+    VkMemoryRequirements const &requirements, u32 memoryTypeIndex,
+    MemoryCategory category, u64 userData, vec<u32> const &excludedBlocks,
+    bool allowNewBlock) {
+  MemoryAllocation allocation{};
+
+  for (auto &[id, block] : mBlocks) {
+    if (block.memoryTypeIndex != memoryTypeIndex ||
+        block.category != category ||
+        block.size - block.used < requirements.size ||
+        std::find(excludedBlocks.begin(), excludedBlocks.end(), id) !=
+            excludedBlocks.end()) {
+      continue;
+    }
+
+    if (this->tryAllocate(id, block, requirements, userData, allocation)) {
+      return allocation;
+    }
+  }
+
+  if (!allowNewBlock) {
+    return allocation;
+  }
+
+  u32 id = this->createBlock(std::max(mBlockSize, requirements.size),
+                             memoryTypeIndex, category);
+  this->tryAllocate(id, mBlocks[id], requirements, userData, allocation);
+  return allocation;
+}
+
+void BlockAllocator::free(MemoryAllocation const &allocation) {
+  auto blockIt = mBlocks.find(allocation.blockId);
+  if (!allocation.isValid() || blockIt == mBlocks.end()) {
+    return;
+  }
+
+  Block &block = blockIt->second;
+  auto rangeIt = block.allocations.find(allocation.offset);
+  if (rangeIt == block.allocations.end()) {
+    return;
+  }
+
+  VkDeviceSize offset = rangeIt->first;
+  VkDeviceSize size = rangeIt->second.size;
+  block.allocations.erase(rangeIt);
+  block.used -= size;
+
+  if (block.allocations.empty()) {
+    mTracker->free(block.memory);
+    mBlocks.erase(blockIt);
+    return;
+  }
+
+  // Merge with the neighbouring free ranges so large requests can still fit.
+  auto next = block.freeRanges.lower_bound(offset);
+  if (next != block.freeRanges.end() && offset + size == next->first) {
+    size += next->second;
+    next = block.freeRanges.erase(next);
+  }
+  if (next != block.freeRanges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      offset = prev->first;
+      size += prev->second;
+      block.freeRanges.erase(prev);
+    }
+  }
+  block.freeRanges[offset] = size;
+}
+
+vec<MemoryBlockStats> BlockAllocator::getBlockStats() const {
+  vec<MemoryBlockStats> stats;
+  stats.reserve(mBlocks.size());
+  for (auto const &[id, block] : mBlocks) {
+    stats.push_back({id, block.memoryTypeIndex, block.category, block.size,
+                     block.used, static_cast<u32>(block.allocations.size())});
+  }
+  return stats;
+}
+
+vec<std::pair<u64, MemoryAllocation>>
+BlockAllocator::getAllocations(u32 blockId) const {
+  vec<std::pair<u64, MemoryAllocation>> allocations;
+  auto blockIt = mBlocks.find(blockId);
+  if (blockIt == mBlocks.end()) {
+    return allocations;
+  }
+
+  Block const &block = blockIt->second;
+  for (auto const &[offset, range] : block.allocations) {
+    allocations.push_back(
+        {range.userData, {block.memory, offset, range.size, blockId}});
+  }
+  return allocations;
+}
+
+} // namespace VulkanTutorial
@@ -0,0 +1,85 @@
+#include <command_cache.hpp>
+
+namespace VulkanTutorial {
+
+void CommandCache::init(VkDevice device, VkAllocationCallbacks const *allocator,
+                        u32 queueFamily, u32 frameCount) {
+  mDevice = device;
+  mAllocator = allocator;
+  mFrameCount = frameCount;
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = queueFamily;
+
+  if (vkCreateCommandPool(mDevice, &poolInfo, mAllocator, &mPool) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create command cache pool.");
+  }
+}
+
+void CommandCache::destroy() {
+  if (mPool != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(mDevice, mPool, mAllocator);
+    mPool = VK_NULL_HANDLE;
+  }
+  mEntries.clear();
+}
+
+void CommandCache::resize(u32 imageCount) {
+  // Buffers for images that no longer exist are kept for a later resize; the
+  // pool frees them on destroy().
+  u32 count = imageCount * mFrameCount;
+  if (count > mEntries.size()) {
+    vec<VkCommandBuffer> commandBuffers(count - mEntries.size());
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = mPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = static_cast<u32>(commandBuffers.size());
+
+    if (vkAllocateCommandBuffers(mDevice, &allocInfo, commandBuffers.data()) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate cached command buffers.");
+    }
+    for (VkCommandBuffer commandBuffer : commandBuffers) {
+      mEntries.push_back({commandBuffer});
+    }
+  }
+
+  this->invalidate();
+}
+
+void CommandCache::invalidate() {
+  for (auto &entry : mEntries) {
+    entry.valid = false;
+  }
+}
+
+VkCommandBuffer CommandCache::get(u32 image, u32 frame, u64 version,
+                                  CommandRecorder const &record) {
+  Entry &entry = mEntries[image * mFrameCount + frame];
+  if (entry.valid && entry.version == version) {
+    ++mHits;
+    return entry.commandBuffer;
+  }
+
+  ++mMisses;
+  // Mark the entry invalid first so a throwing recorder does not leave a
+  // half-recorded buffer behind as valid.
+  entry.valid = false;
+  vkResetCommandBuffer(entry.commandBuffer, 0);
+  record(entry.commandBuffer);
+  entry.version = version;
+  entry.valid = true;
+  return entry.commandBuffer;
+}
+
+void CommandCache::log(std::ostream &stream) const {
+  stream << "[CommandCache] " << mHits << " hits, " << mMisses << " misses, "
+         << mEntries.size() << " buffers" << std::endl;
+}
+
+} // namespace VulkanTutorial
@@ -4,7 +4,14 @@ namespace VulkanTutorial {
 
 QueueFamilyIndices::operator uset<i32>() const {
   if (this->isComplete()) {
-    return uset<i32>{graphicsFamily, presentFamily};
+    uset<i32> families{graphicsFamily, presentFamily};
+    if (transferFamily >= 0) {
+      families.insert(transferFamily);
+    }
+    if (computeFamily >= 0) {
+      families.insert(computeFamily);
+    }
+    return families;
   } else {
     return uset<i32>{};
   }
@@ -0,0 +1,93 @@
+#include <defragmenter.hpp>
+
+namespace VulkanTutorial {
+
+void Defragmenter::init(BlockAllocator *allocator,
+                        DefragmentationBudget const &budget) {
+  mAllocator = allocator;
+  mBudget = budget;
+}
+
+bool Defragmenter::beginPass() {
+  if (this->isActive()) {
+    return true;
+  }
+
+  mSourceBlocks.clear();
+
+  // Blocks can only be compacted into blocks of the same memory type and
+  // category, so group them first.
+  map<std::pair<u32, MemoryCategory>, vec<MemoryBlockStats>> groups;
+  for (auto const &stats : mAllocator->getBlockStats()) {
+    groups[{stats.memoryTypeIndex, stats.category}].push_back(stats);
+  }
+
+  for (auto &[key, blocks] : groups) {
+    if (blocks.size() < 2) {
+      continue;
+    }
+
+    std::sort(blocks.begin(), blocks.end(),
+              [](MemoryBlockStats const &a, MemoryBlockStats const &b) {
+                return a.occupancy() < b.occupancy();
+              });
+
+    VkDeviceSize freeBytes = 0;
+    for (auto const &block : blocks) {
+      freeBytes += block.size - block.used;
+    }
+
+    // Empty the sparsest blocks first as long as the remaining blocks still
+    // have room for their contents.
+    for (u32 i = 0; i + 1 < blocks.size(); ++i) {
+      MemoryBlockStats const &block = blocks[i];
+      freeBytes -= block.size - block.used;
+      if (block.occupancy() >= mBudget.occupancyThreshold ||
+          block.used > freeBytes) {
+        break;
+      }
+
+      freeBytes -= block.used;
+      mSourceBlocks.push_back(block.id);
+      for (auto const &[userData, allocation] :
+           mAllocator->getAllocations(block.id)) {
+        mMoves.push_back({userData, allocation});
+      }
+    }
+  }
+
+  return this->isActive();
+}
+
+u32 Defragmenter::step(DefragmentationCallback const &callback) {
+  auto start = std::chrono::steady_clock::now();
+  VkDeviceSize bytes = 0;
+  u32 moved = 0;
+
+  while (!mMoves.empty()) {
+    Move const &move = mMoves.front();
+    if (bytes > 0 && bytes + move.allocation.size > mBudget.maxBytesPerFrame) {
+      break;
+    }
+    if (std::chrono::steady_clock::now() - start >= mBudget.maxTimePerFrame) {
+      break;
+    }
+
+    if (callback(move.userData, move.allocation, mSourceBlocks)) {
+      bytes += move.allocation.size;
+      ++moved;
+    }
+    mMoves.pop_front();
+  }
+
+  mMovedBytes += bytes;
+  mMovedCount += moved;
+  return moved;
+}
+
+void Defragmenter::log(std::ostream &stream) const {
+  stream << "[Defragmenter] " << mMovedCount << " allocations moved, "
+         << mMovedBytes << " bytes" << std::endl;
+}
+
+} // namespace VulkanTutorial
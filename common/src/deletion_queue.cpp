@@ -0,0 +1,152 @@
+#include <deletion_queue.hpp>
+
+namespace VulkanTutorial {
+
+void DeletionQueue::init(VkDevice device,
+                         VkAllocationCallbacks const *allocator,
+                         bool useTimeline) {
+  mDevice = device;
+  mAllocator = allocator;
+
+  if (!useTimeline) {
+    return;
+  }
+
+  VkSemaphoreTypeCreateInfo typeInfo{};
+  typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue = mLastSubmission;
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &typeInfo;
+
+  if (vkCreateSemaphore(mDevice, &semaphoreInfo, mAllocator, &mTimeline) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create timeline semaphore.");
+  }
+}
+
+void DeletionQueue::destroy() {
+  if (mTimeline != VK_NULL_HANDLE) {
+    vkDestroySemaphore(mDevice, mTimeline, mAllocator);
+    mTimeline = VK_NULL_HANDLE;
+  }
+}
+
+void DeletionQueue::markCompleted(u64 value) {
+  mCompletedValue = std::max(mCompletedValue, value);
+}
+
+void DeletionQueue::watch(u64 value, VkFence fence) {
+  mWatchedFences.push_back({value, fence});
+}
+
+bool DeletionQueue::wait(u64 value) {
+  if (this->isComplete(value)) {
+    return true;
+  }
+
+  if (mTimeline != VK_NULL_HANDLE) {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &mTimeline;
+    waitInfo.pValues = &value;
+    vkWaitSemaphores(mDevice, &waitInfo, UINT64_MAX);
+    this->markCompleted(value);
+    return true;
+  }
+
+  WatchedFence const *closest = nullptr;
+  for (auto const &watched : mWatchedFences) {
+    if (watched.value >= value &&
+        (closest == nullptr || watched.value < closest->value)) {
+      closest = &watched;
+    }
+  }
+  if (closest == nullptr) {
+    return false;
+  }
+
+  vkWaitForFences(mDevice, 1, &closest->fence, VK_TRUE, UINT64_MAX);
+  this->markCompleted(closest->value);
+  return true;
+}
+
+void DeletionQueue::retire(u64 value, DeletionCallback const &destroy) {
+  mEntries.push_back({value, destroy});
+}
+
+void DeletionQueue::retireBuffer(u64 value, VkBuffer buffer) {
+  this->retire(value, [device = mDevice, allocator = mAllocator, buffer]() {
+    vkDestroyBuffer(device, buffer, allocator);
+  });
+}
+
+void DeletionQueue::retireImage(u64 value, VkImage image) {
+  this->retire(value, [device = mDevice, allocator = mAllocator, image]() {
+    vkDestroyImage(device, image, allocator);
+  });
+}
+
+void DeletionQueue::retireImageView(u64 value, VkImageView view) {
+  this->retire(value, [device = mDevice, allocator = mAllocator, view]() {
+    vkDestroyImageView(device, view, allocator);
+  });
+}
+
+void DeletionQueue::retireFramebuffer(u64 value, VkFramebuffer framebuffer) {
+  this->retire(value,
+               [device = mDevice, allocator = mAllocator, framebuffer]() {
+                 vkDestroyFramebuffer(device, framebuffer, allocator);
+               });
+}
+
+void DeletionQueue::retirePipeline(u64 value, VkPipeline pipeline) {
+  this->retire(value, [device = mDevice, allocator = mAllocator, pipeline]() {
+    vkDestroyPipeline(device, pipeline, allocator);
+  });
+}
+
+u32 DeletionQueue::collect() {
+  if (mTimeline != VK_NULL_HANDLE) {
+    u64 counter = 0;
+    vkGetSemaphoreCounterValue(mDevice, mTimeline, &counter);
+    this->markCompleted(counter);
+  }
+
+  std::erase_if(mWatchedFences, [this](WatchedFence const &watched) {
+    if (vkGetFenceStatus(mDevice, watched.fence) != VK_SUCCESS) {
+      return false;
+    }
+    this->markCompleted(watched.value);
+    return true;
+  });
+
+  // Run the callbacks after the sweep so they are free to retire more work.
+  vec<Entry> completed;
+  std::erase_if(mEntries, [&](Entry const &entry) {
+    if (!this->isComplete(entry.value)) {
+      return false;
+    }
+    completed.push_back(entry);
+    return true;
+  });
+
+  for (auto const &entry : completed) {
+    entry.destroy();
+  }
+
+  mDestroyedCount += completed.size();
+  return static_cast<u32>(completed.size());
+}
+
+void DeletionQueue::flush() {
+  // Only valid once the device is idle.
+  mWatchedFences.clear();
+  this->markCompleted(mLastSubmission);
+  this->collect();
+}
+
+} // namespace VulkanTutorial
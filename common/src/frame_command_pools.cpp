@@ -0,0 +1,83 @@
+#include <frame_command_pools.hpp>
+
+namespace VulkanTutorial {
+
+u32 FrameCommandPools::getAllocatedCount() const {
+  u32 count = 0;
+  for (auto const &pool : mPools) {
+    count += static_cast<u32>(pool.primaries.size() + pool.secondaries.size());
+  }
+  return count;
+}
+
+void FrameCommandPools::init(VkDevice device,
+                             VkAllocationCallbacks const *allocator,
+                             u32 queueFamily, u32 frameCount,
+                             u32 threadCount) {
+  mDevice = device;
+  mAllocator = allocator;
+  mThreadCount = threadCount;
+  mFrame = 0;
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  poolInfo.queueFamilyIndex = queueFamily;
+
+  mPools.resize(frameCount * threadCount);
+  for (auto &pool : mPools) {
+    if (vkCreateCommandPool(mDevice, &poolInfo, mAllocator, &pool.pool) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("Failed to create frame command pool.");
+    }
+  }
+}
+
+void FrameCommandPools::destroy() {
+  // Destroying a pool frees its command buffers.
+  for (auto const &pool : mPools) {
+    vkDestroyCommandPool(mDevice, pool.pool, mAllocator);
+  }
+  mPools.clear();
+}
+
+void FrameCommandPools::beginFrame(u32 frame) {
+  mFrame = frame;
+  for (u32 i = 0; i < mThreadCount; ++i) {
+    Pool &pool = mPools[frame * mThreadCount + i];
+    if (pool.usedPrimaries + pool.usedSecondaries == 0) {
+      continue;
+    }
+
+    vkResetCommandPool(mDevice, pool.pool, 0);
+    pool.usedPrimaries = 0;
+    pool.usedSecondaries = 0;
+  }
+}
+
+VkCommandBuffer FrameCommandPools::acquire(u32 thread,
+                                           VkCommandBufferLevel level) {
+  Pool &pool = mPools[mFrame * mThreadCount + thread];
+  bool primary = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  vec<VkCommandBuffer> &buffers = primary ? pool.primaries : pool.secondaries;
+  u32 &used = primary ? pool.usedPrimaries : pool.usedSecondaries;
+
+  if (used == buffers.size()) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = pool.pool;
+    allocInfo.level = level;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(mDevice, &allocInfo, &commandBuffer) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate frame command buffer.");
+    }
+    buffers.push_back(commandBuffer);
+  }
+
+  return buffers[used++];
+}
+
+} // namespace VulkanTutorial
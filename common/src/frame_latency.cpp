@@ -0,0 +1,81 @@
+#include <frame_latency.hpp>
+
+namespace VulkanTutorial {
+
+namespace {
+double toMilliseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+} // namespace
+
+void FrameLatency::init(u32 framesInFlight) {
+  mFrames.assign(framesInFlight, Frame{});
+  mLast = {};
+  mLastLog = Clock::now();
+  this->resetWindow();
+}
+
+void FrameLatency::resetWindow() {
+  mTotal = {};
+  mMin = Clock::duration::max();
+  mMax = {};
+  mSamples = 0;
+}
+
+void FrameLatency::beginFrame(u32 frame) {
+  mFrames[frame].start = Clock::now();
+  mFrames[frame].pending = false;
+}
+
+void FrameLatency::submit(u32 frame, u64 submission) {
+  mFrames[frame].submission = submission;
+  mFrames[frame].pending = true;
+}
+
+void FrameLatency::update(DeletionQueue const &progress) {
+  auto now = Clock::now();
+  for (auto &frame : mFrames) {
+    if (!frame.pending || !progress.isComplete(frame.submission)) {
+      continue;
+    }
+
+    frame.pending = false;
+    mLast = now - frame.start;
+    mTotal += mLast;
+    mMin = std::min(mMin, mLast);
+    mMax = std::max(mMax, mLast);
+    ++mSamples;
+  }
+}
+
+void FrameLatency::tick() {
+  if (mLogInterval.count() <= 0) {
+    return;
+  }
+
+  auto now = Clock::now();
+  if (now - mLastLog < mLogInterval) {
+    return;
+  }
+  mLastLog = now;
+
+  this->log(std::cout);
+  this->resetWindow();
+}
+
+void FrameLatency::log(std::ostream &stream) const {
+  stream << std::fixed << std::setprecision(2) << "[Latency] "
+         << this->getFramesInFlight() << " frames in flight:";
+  if (mSamples == 0) {
+    stream << " no completed frames" << std::defaultfloat << std::endl;
+    return;
+  }
+
+  stream << " last " << toMilliseconds(mLast) << " ms, avg "
+         << toMilliseconds(this->getAverage()) << " ms, min "
+         << toMilliseconds(mMin) << " ms, max " << toMilliseconds(mMax)
+         << " ms over " << mSamples << " frames" << std::defaultfloat
+         << std::endl;
+}
+
+} // namespace VulkanTutorial
@@ -0,0 +1,319 @@
+#include <host_allocator.hpp>
+
+namespace VulkanTutorial {
+
+namespace {
+static constexpr u16 LARGE_CLASS = 0xffff;
+
+// Stored directly in front of every pointer handed to the driver.
+struct Header {
+  u16 sizeClass;
+  u8 scope;
+  u8 reserved;
+  u32 offset; // Distance from the start of the block to the user pointer
+  u64 size;
+};
+static_assert(sizeof(Header) == 16);
+
+Header *getHeader(void *memory) {
+  return reinterpret_cast<Header *>(static_cast<u8 *>(memory) -
+                                    sizeof(Header));
+}
+
+char const *toString(VkSystemAllocationScope scope) {
+  switch (scope) {
+  case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:
+    return "command";
+  case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:
+    return "object";
+  case VK_SYSTEM_ALLOCATION_SCOPE_CACHE:
+    return "cache";
+  case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:
+    return "device";
+  case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE:
+    return "instance";
+  default:
+    return "unknown";
+  }
+}
+
+VKAPI_ATTR void *VKAPI_CALL allocationCallback(void *pUserData, size_t size,
+                                               size_t alignment,
+                                               VkSystemAllocationScope scope) {
+  return static_cast<HostAllocator *>(pUserData)->allocate(size, alignment,
+                                                           scope);
+}
+
+VKAPI_ATTR void *VKAPI_CALL
+reallocationCallback(void *pUserData, void *pOriginal, size_t size,
+                     size_t alignment, VkSystemAllocationScope scope) {
+  return static_cast<HostAllocator *>(pUserData)->reallocate(pOriginal, size,
+                                                             alignment, scope);
+}
+
+VKAPI_ATTR void VKAPI_CALL freeCallback(void *pUserData, void *pMemory) {
+  static_cast<HostAllocator *>(pUserData)->free(pMemory);
+}
+
+VKAPI_ATTR void VKAPI_CALL internalAllocationNotification(
+    void *pUserData, size_t size,
+    [[maybe_unused]] VkInternalAllocationType allocationType,
+    VkSystemAllocationScope scope) {
+  static_cast<HostAllocator *>(pUserData)->recordInternalAllocation(scope,
+                                                                   size);
+}
+
+VKAPI_ATTR void VKAPI_CALL internalFreeNotification(
+    void *pUserData, size_t size,
+    [[maybe_unused]] VkInternalAllocationType allocationType,
+    VkSystemAllocationScope scope) {
+  static_cast<HostAllocator *>(pUserData)->recordInternalFree(scope, size);
+}
+} // namespace
+
+HostAllocator::ThreadCache::~ThreadCache() {
+  HostAllocator &allocator = HostAllocator::get();
+  for (u32 i = 0; i < SIZE_CLASS_COUNT; ++i) {
+    allocator.release(*this, i, counts[i]);
+  }
+}
+
+HostAllocator::HostAllocator() {
+  mCallbacks.pUserData = this;
+  mCallbacks.pfnAllocation = allocationCallback;
+  mCallbacks.pfnReallocation = reallocationCallback;
+  mCallbacks.pfnFree = freeCallback;
+  mCallbacks.pfnInternalAllocation = internalAllocationNotification;
+  mCallbacks.pfnInternalFree = internalFreeNotification;
+}
+
+HostAllocator::~HostAllocator() {
+  for (void *slab : mSlabs) {
+    std::free(slab);
+  }
+}
+
+HostAllocator &HostAllocator::get() {
+  static HostAllocator instance;
+  return instance;
+}
+
+HostAllocator::ThreadCache &HostAllocator::getThreadCache() {
+  thread_local ThreadCache cache;
+  return cache;
+}
+
+void HostAllocator::refill(ThreadCache &cache, u32 sizeClass) {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (mFreeLists[sizeClass] == nullptr) {
+    size_t blockSize = SIZE_CLASSES[sizeClass];
+    u8 *slab = static_cast<u8 *>(std::aligned_alloc(64, SLAB_SIZE));
+    if (slab == nullptr) {
+      return;
+    }
+    mSlabs.push_back(slab);
+
+    for (size_t offset = 0; offset + blockSize <= SLAB_SIZE;
+         offset += blockSize) {
+      FreeNode *node = reinterpret_cast<FreeNode *>(slab + offset);
+      node->next = mFreeLists[sizeClass];
+      mFreeLists[sizeClass] = node;
+    }
+  }
+
+  for (u32 i = 0; i < CACHE_BATCH && mFreeLists[sizeClass] != nullptr; ++i) {
+    FreeNode *node = mFreeLists[sizeClass];
+    mFreeLists[sizeClass] = node->next;
+    node->next = cache.heads[sizeClass];
+    cache.heads[sizeClass] = node;
+    ++cache.counts[sizeClass];
+  }
+}
+
+void HostAllocator::release(ThreadCache &cache, u32 sizeClass, u32 count) {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  for (u32 i = 0; i < count && cache.heads[sizeClass] != nullptr; ++i) {
+    FreeNode *node = cache.heads[sizeClass];
+    cache.heads[sizeClass] = node->next;
+    --cache.counts[sizeClass];
+    node->next = mFreeLists[sizeClass];
+    mFreeLists[sizeClass] = node;
+  }
+}
+
+void *HostAllocator::allocateBlock(u32 sizeClass) {
+  ThreadCache &cache = HostAllocator::getThreadCache();
+  if (cache.heads[sizeClass] == nullptr) {
+    this->refill(cache, sizeClass);
+    if (cache.heads[sizeClass] == nullptr) {
+      return nullptr;
+    }
+  }
+
+  FreeNode *node = cache.heads[sizeClass];
+  cache.heads[sizeClass] = node->next;
+  --cache.counts[sizeClass];
+  return node;
+}
+
+void HostAllocator::freeBlock(void *block, u32 sizeClass) {
+  ThreadCache &cache = HostAllocator::getThreadCache();
+  FreeNode *node = static_cast<FreeNode *>(block);
+  node->next = cache.heads[sizeClass];
+  cache.heads[sizeClass] = node;
+  ++cache.counts[sizeClass];
+
+  if (cache.counts[sizeClass] > CACHE_LIMIT) {
+    this->release(cache, sizeClass, CACHE_BATCH);
+  }
+}
+
+void HostAllocator::recordAllocation(VkSystemAllocationScope scope,
+                                     u64 size) {
+  ScopeCounters &counters = mScopes[scope];
+  u64 current = counters.currentBytes += size;
+  ++counters.allocationCount;
+  ++counters.liveAllocations;
+
+  u64 peak = counters.peakBytes;
+  while (current > peak &&
+         !counters.peakBytes.compare_exchange_weak(peak, current)) {
+  }
+}
+
+void HostAllocator::recordFree(VkSystemAllocationScope scope, u64 size) {
+  ScopeCounters &counters = mScopes[scope];
+  counters.currentBytes -= size;
+  --counters.liveAllocations;
+}
+
+HostAllocationStats
+HostAllocator::getStats(VkSystemAllocationScope scope) const {
+  ScopeCounters const &counters = mScopes[scope];
+  return {counters.currentBytes, counters.peakBytes, counters.allocationCount,
+          counters.liveAllocations, counters.internalBytes};
+}
+
+u64 HostAllocator::getInternalBytes() const {
+  u64 total = 0;
+  for (auto const &counters : mScopes) {
+    total += counters.internalBytes;
+  }
+  return total;
+}
+
+u64 HostAllocator::getTotalBytes() const {
+  u64 total = 0;
+  for (auto const &counters : mScopes) {
+    total += counters.currentBytes;
+  }
+  return total;
+}
+
+void *HostAllocator::allocate(size_t size, size_t alignment,
+                              VkSystemAllocationScope scope) {
+  if (size == 0) {
+    return nullptr;
+  }
+
+  // Every block starts 16-byte aligned, so the header plus the padding needed
+  // for the requested alignment never exceeds max(16, alignment).
+  size_t padding = std::max(sizeof(Header), alignment);
+  size_t required = size + padding;
+
+  u16 sizeClass = LARGE_CLASS;
+  for (u32 i = 0; i < SIZE_CLASS_COUNT; ++i) {
+    if (required <= SIZE_CLASSES[i]) {
+      sizeClass = static_cast<u16>(i);
+      break;
+    }
+  }
+
+  u8 *block = static_cast<u8 *>(sizeClass == LARGE_CLASS
+                                    ? std::malloc(required)
+                                    : this->allocateBlock(sizeClass));
+  if (block == nullptr) {
+    return nullptr;
+  }
+
+  uintptr_t base = reinterpret_cast<uintptr_t>(block) + sizeof(Header);
+  uintptr_t aligned = (base + alignment - 1) & ~(uintptr_t(alignment) - 1);
+  void *memory = reinterpret_cast<void *>(aligned);
+
+  Header *header = getHeader(memory);
+  header->sizeClass = sizeClass;
+  header->scope = static_cast<u8>(scope);
+  header->offset = static_cast<u32>(static_cast<u8 *>(memory) - block);
+  header->size = size;
+
+  this->recordAllocation(scope, size);
+  return memory;
+}
+
+void *HostAllocator::reallocate(void *original, size_t size, size_t alignment,
+                                VkSystemAllocationScope scope) {
+  if (original == nullptr) {
+    return this->allocate(size, alignment, scope);
+  }
+  if (size == 0) {
+    this->free(original);
+    return nullptr;
+  }
+
+  Header *header = getHeader(original);
+  size_t capacity = header->sizeClass == LARGE_CLASS
+                        ? header->size
+                        : SIZE_CLASSES[header->sizeClass] - header->offset;
+  if (size <= capacity &&
+      reinterpret_cast<uintptr_t>(original) % alignment == 0) {
+    VkSystemAllocationScope originalScope =
+        static_cast<VkSystemAllocationScope>(header->scope);
+    this->recordFree(originalScope, header->size);
+    this->recordAllocation(scope, size);
+    header->scope = static_cast<u8>(scope);
+    header->size = size;
+    return original;
+  }
+
+  void *memory = this->allocate(size, alignment, scope);
+  if (memory == nullptr) {
+    return nullptr;
+  }
+  std::memcpy(memory, original, std::min<size_t>(size, header->size));
+  this->free(original);
+  return memory;
+}
+
+void HostAllocator::free(void *memory) {
+  if (memory == nullptr) {
+    return;
+  }
+
+  Header *header = getHeader(memory);
+  this->recordFree(static_cast<VkSystemAllocationScope>(header->scope),
+                   header->size);
+
+  void *block = static_cast<u8 *>(memory) - header->offset;
+  if (header->sizeClass == LARGE_CLASS) {
+    std::free(block);
+  } else {
+    this->freeBlock(block, header->sizeClass);
+  }
+}
+
+void HostAllocator::log(std::ostream &stream) const {
+  stream << "[HostAllocator]";
+  for (u32 i = 0; i < ALLOCATION_SCOPE_COUNT; ++i) {
+    HostAllocationStats stats =
+        this->getStats(static_cast<VkSystemAllocationScope>(i));
+    stream << " " << toString(static_cast<VkSystemAllocationScope>(i)) << " "
+           << stats.currentBytes << "B (peak " << stats.peakBytes << "B, "
+           << stats.allocationCount << " allocs, " << stats.internalBytes
+           << "B internal);";
+  }
+  stream << std::endl;
+}
+
+} // namespace VulkanTutorial
@@ -0,0 +1,75 @@
+#include <memory_report.hpp>
+
+namespace VulkanTutorial {
+
+namespace {
+double toMiB(u64 bytes) {
+  return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+} // namespace
+
+ProcessMemoryUsage MemoryReport::queryProcessUsage() {
+  ProcessMemoryUsage usage{};
+
+  // Only Linux exposes this without platform headers; elsewhere the report
+  // still lists the per-subsystem totals.
+  std::ifstream status("/proc/self/status");
+  str line;
+  while (std::getline(status, line)) {
+    u64 *target = nullptr;
+    if (line.rfind("VmRSS:", 0) == 0) {
+      target = &usage.residentBytes;
+    } else if (line.rfind("VmHWM:", 0) == 0) {
+      target = &usage.peakResidentBytes;
+    } else {
+      continue;
+    }
+
+    size_t begin = line.find_first_of("0123456789");
+    if (begin != str::npos) {
+      *target = std::strtoull(line.c_str() + begin, nullptr, 10) * 1024;
+    }
+  }
+
+  return usage;
+}
+
+u64 MemoryReport::getSubsystemBytes(str const &subsystem) const {
+  auto it = mSubsystems.find(subsystem);
+  return it != mSubsystems.end() ? it->second : 0;
+}
+
+u64 MemoryReport::getAttributedBytes() const {
+  u64 total = 0;
+  for (auto const &[subsystem, bytes] : mSubsystems) {
+    total += bytes;
+  }
+  return total;
+}
+
+void MemoryReport::log(std::ostream &stream) const {
+  stream << std::fixed << std::setprecision(1);
+  stream << "[MemoryReport]";
+  if (mProcess.isValid()) {
+    stream << " rss " << toMiB(mProcess.residentBytes) << " MiB (peak "
+           << toMiB(mProcess.peakResidentBytes) << " MiB)";
+  }
+  stream << std::endl;
+
+  for (auto const &[subsystem, bytes] : mSubsystems) {
+    stream << "  " << subsystem << ": " << toMiB(bytes) << " MiB" << std::endl;
+  }
+
+  u64 attributed = this->getAttributedBytes();
+  if (mProcess.isValid() && mProcess.residentBytes > attributed) {
+    stream << "  unattributed: " << toMiB(mProcess.residentBytes - attributed)
+           << " MiB" << std::endl;
+  }
+  for (auto const &[subsystem, bytes] : mPeaks) {
+    stream << "  " << subsystem << " (peak, freed): " << toMiB(bytes)
+           << " MiB" << std::endl;
+  }
+  stream << std::defaultfloat;
+}
+
+} // namespace VulkanTutorial
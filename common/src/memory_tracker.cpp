@@ -0,0 +1,184 @@
+#include <memory_tracker.hpp>
+
+namespace VulkanTutorial {
+
+namespace {
+double toMiB(VkDeviceSize bytes) {
+  return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+} // namespace
+
+char const *toString(MemoryCategory category) {
+  switch (category) {
+  case MemoryCategory::GEOMETRY:
+    return "geometry";
+  case MemoryCategory::TEXTURE:
+    return "texture";
+  case MemoryCategory::ATTACHMENT:
+    return "attachment";
+  case MemoryCategory::STAGING:
+    return "staging";
+  case MemoryCategory::UNIFORM:
+    return "uniform";
+  default:
+    return "unknown";
+  }
+}
+
+void MemoryTracker::queryBudget() {
+  if (!mBudgetSupported) {
+    // Without VK_EXT_memory_budget the best estimate is the heap size and the
+    // bytes we have allocated ourselves.
+    for (u32 i = 0; i < mMemoryProperties.memoryHeapCount; ++i) {
+      mHeaps[i].budget = mHeaps[i].size;
+      mHeaps[i].usage = mHeaps[i].tracked;
+    }
+    return;
+  }
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+  budgetProperties.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+  VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+  memoryProperties.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+  memoryProperties.pNext = &budgetProperties;
+  vkGetPhysicalDeviceMemoryProperties2(mPhysicalDevice, &memoryProperties);
+
+  for (u32 i = 0; i < mMemoryProperties.memoryHeapCount; ++i) {
+    mHeaps[i].budget = budgetProperties.heapBudget[i];
+    mHeaps[i].usage = budgetProperties.heapUsage[i];
+  }
+}
+
+bool MemoryTracker::checkBudget(u32 heapIndex, VkDeviceSize incoming) {
+  MemoryHeapStatus &heap = mHeaps[heapIndex];
+  VkDeviceSize limit =
+      static_cast<VkDeviceSize>(heap.budget * mWarningThreshold);
+  if (heap.usage + incoming <= limit) {
+    return true;
+  }
+
+  std::cerr << "WARNING: [Memory] heap " << heapIndex << " would reach "
+            << toMiB(heap.usage + incoming) << " MiB of a "
+            << toMiB(heap.budget) << " MiB budget." << std::endl;
+
+  if (mEvictionCallback) {
+    mEvictionCallback(heapIndex, heap.usage + incoming - limit);
+    this->queryBudget();
+  }
+
+  return heap.usage + incoming <= heap.budget;
+}
+
+VkDeviceSize MemoryTracker::getTotalTracked() const {
+  VkDeviceSize total = 0;
+  for (auto const size : mCategoryTotals) {
+    total += size;
+  }
+  return total;
+}
+
+void MemoryTracker::init(VkPhysicalDevice physicalDevice, VkDevice device,
+                         bool budgetSupported,
+                         VkAllocationCallbacks const *allocator) {
+  mPhysicalDevice = physicalDevice;
+  mDevice = device;
+  mAllocator = allocator;
+  mBudgetSupported = budgetSupported;
+
+  vkGetPhysicalDeviceMemoryProperties(mPhysicalDevice, &mMemoryProperties);
+  for (u32 i = 0; i < mMemoryProperties.memoryHeapCount; ++i) {
+    VkMemoryHeap const &heap = mMemoryProperties.memoryHeaps[i];
+    mHeaps[i].size = heap.size;
+    mHeaps[i].deviceLocal = heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+  }
+
+  this->queryBudget();
+  mLastLog = std::chrono::steady_clock::now();
+}
+
+VkResult MemoryTracker::allocate(VkMemoryAllocateInfo const &allocInfo,
+                                 MemoryCategory category,
+                                 VkDeviceMemory *memory) {
+  u32 heapIndex =
+      mMemoryProperties.memoryTypes[allocInfo.memoryTypeIndex].heapIndex;
+  if (!this->checkBudget(heapIndex, allocInfo.allocationSize)) {
+    std::cerr << "WARNING: [Memory] allocating "
+              << toMiB(allocInfo.allocationSize) << " MiB of "
+              << toString(category) << " memory past the heap budget."
+              << std::endl;
+  }
+
+  VkResult result = vkAllocateMemory(mDevice, &allocInfo, mAllocator, memory);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+
+  mAllocations[*memory] = {allocInfo.allocationSize, heapIndex, category};
+  mCategoryTotals[static_cast<u32>(category)] += allocInfo.allocationSize;
+  mHeaps[heapIndex].tracked += allocInfo.allocationSize;
+  mHeaps[heapIndex].usage += allocInfo.allocationSize;
+  return result;
+}
+
+void MemoryTracker::free(VkDeviceMemory memory) {
+  if (memory == VK_NULL_HANDLE) {
+    return;
+  }
+
+  auto it = mAllocations.find(memory);
+  if (it != mAllocations.end()) {
+    Allocation const &allocation = it->second;
+    MemoryHeapStatus &heap = mHeaps[allocation.heapIndex];
+    mCategoryTotals[static_cast<u32>(allocation.category)] -= allocation.size;
+    heap.tracked -= allocation.size;
+    heap.usage -= std::min(heap.usage, allocation.size);
+    mAllocations.erase(it);
+  }
+
+  vkFreeMemory(mDevice, memory, mAllocator);
+}
+
+void MemoryTracker::update() {
+  this->queryBudget();
+
+  for (u32 i = 0; i < mMemoryProperties.memoryHeapCount; ++i) {
+    this->checkBudget(i, 0);
+  }
+}
+
+void MemoryTracker::tick() {
+  if (mLogInterval.count() <= 0) {
+    return;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  if (now - mLastLog < mLogInterval) {
+    return;
+  }
+  mLastLog = now;
+
+  this->update();
+  this->log(std::cout);
+}
+
+void MemoryTracker::log(std::ostream &stream) {
+  stream << std::fixed << std::setprecision(1) << "[Memory]";
+  for (u32 i = 0; i < mMemoryProperties.memoryHeapCount; ++i) {
+    MemoryHeapStatus const &heap = mHeaps[i];
+    stream << " heap" << i << (heap.deviceLocal ? "(device)" : "(host)")
+           << " " << toMiB(heap.usage) << "/" << toMiB(heap.budget)
+           << " MiB, headroom " << toMiB(heap.headroom()) << " MiB;";
+  }
+
+  stream << " |";
+  for (u32 i = 0; i < MEMORY_CATEGORY_COUNT; ++i) {
+    stream << " " << toString(static_cast<MemoryCategory>(i)) << " "
+           << toMiB(mCategoryTotals[i]) << " MiB";
+  }
+  stream << std::defaultfloat << std::endl;
+}
+
+} // namespace VulkanTutorial
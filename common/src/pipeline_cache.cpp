@@ -0,0 +1,257 @@
+#include <pipeline_cache.hpp>
+
+#include <filesystem>
+
+namespace VulkanTutorial {
+
+namespace {
+constexpr u32 FILE_MAGIC = 0x43505456; // "VTPC"
+constexpr u32 FILE_VERSION = 1;
+constexpr u32 PROGRAM_NAME_SIZE = 32;
+
+struct FileHeader {
+  u32 magic;
+  u32 version;
+  u32 baselineCount;
+  u32 reserved;
+  u64 dataSize;
+};
+
+struct FileBaseline {
+  char program[PROGRAM_NAME_SIZE];
+  u64 nanoseconds;
+};
+
+double toMilliseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+bool isCompatible(vec<char> const &data,
+                  VkPhysicalDeviceProperties const &properties) {
+  VkPipelineCacheHeaderVersionOne header;
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  return header.headerSize >= sizeof(header) &&
+         header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID == properties.vendorID &&
+         header.deviceID == properties.deviceID &&
+         std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+                     VK_UUID_SIZE) == 0;
+}
+} // namespace
+
+void PipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice device,
+                         VkAllocationCallbacks const *allocator,
+                         str const &program, str const &path) {
+  mDevice = device;
+  mAllocator = allocator;
+  mPath = path;
+  mProgram = program.substr(0, PROGRAM_NAME_SIZE - 1);
+  mCreationTime = {};
+  mPipelineCount = 0;
+
+  vec<char> data = this->load(physicalDevice);
+  mLoadedSize = data.size();
+  mWarm = !data.empty() &&
+          std::any_of(mBaselines.begin(), mBaselines.end(),
+                      [this](Baseline const &baseline) {
+                        return baseline.program == mProgram;
+                      });
+
+  VkPipelineCacheCreateInfo cacheInfo{};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = data.size();
+  cacheInfo.pInitialData = data.data();
+
+  if (vkCreatePipelineCache(mDevice, &cacheInfo, mAllocator, &mCache) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create pipeline cache.");
+  }
+}
+
+void PipelineCache::destroy() {
+  if (mCache == VK_NULL_HANDLE) {
+    return;
+  }
+
+  if (!mWarm && mPipelineCount > 0) {
+    auto it = std::find_if(mBaselines.begin(), mBaselines.end(),
+                           [this](Baseline const &baseline) {
+                             return baseline.program == mProgram;
+                           });
+    if (it == mBaselines.end()) {
+      mBaselines.push_back({mProgram, mCreationTime});
+    } else {
+      it->creationTime = mCreationTime;
+    }
+  }
+  this->save();
+
+  vkDestroyPipelineCache(mDevice, mCache, mAllocator);
+  mCache = VK_NULL_HANDLE;
+}
+
+vec<char> PipelineCache::load(VkPhysicalDevice physicalDevice) {
+  mBaselines.clear();
+
+  std::ifstream file(mPath, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return {};
+  }
+  u64 fileSize = static_cast<u64>(file.tellg());
+  file.seekg(0);
+
+  FileHeader header{};
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!file || header.magic != FILE_MAGIC || header.version != FILE_VERSION) {
+    std::cerr << "WARNING: Ignoring unrecognized pipeline cache file."
+              << std::endl;
+    return {};
+  }
+
+  // The counts are checked against the file before anything is sized from
+  // them, so a corrupt header cannot ask for gigabytes.
+  u64 baselineSize = u64{header.baselineCount} * sizeof(FileBaseline);
+  u64 payloadSize = fileSize - sizeof(header);
+  if (baselineSize > payloadSize ||
+      header.dataSize != payloadSize - baselineSize) {
+    std::cerr << "WARNING: Ignoring truncated pipeline cache file."
+              << std::endl;
+    return {};
+  }
+
+  vec<Baseline> baselines(header.baselineCount);
+  for (auto &baseline : baselines) {
+    FileBaseline entry{};
+    file.read(reinterpret_cast<char *>(&entry), sizeof(entry));
+    entry.program[PROGRAM_NAME_SIZE - 1] = '\0';
+    baseline.program = entry.program;
+    baseline.creationTime = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::nanoseconds(entry.nanoseconds));
+  }
+
+  vec<char> data(header.dataSize);
+  file.read(data.data(), static_cast<std::streamsize>(data.size()));
+  if (!file) {
+    std::cerr << "WARNING: Ignoring truncated pipeline cache file."
+              << std::endl;
+    return {};
+  }
+
+  // A driver update or another GPU invalidates the data, and with it the
+  // baselines, which were measured against a cache that no longer applies.
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  if (!isCompatible(data, properties)) {
+    return {};
+  }
+
+  mBaselines = std::move(baselines);
+  return data;
+}
+
+void PipelineCache::save() const {
+  size_t size = 0;
+  vec<char> data;
+  if (vkGetPipelineCacheData(mDevice, mCache, &size, nullptr) != VK_SUCCESS) {
+    std::cerr << "WARNING: Failed to read pipeline cache data." << std::endl;
+    return;
+  }
+  data.resize(size);
+  if (vkGetPipelineCacheData(mDevice, mCache, &size, data.data()) !=
+      VK_SUCCESS) {
+    std::cerr << "WARNING: Failed to read pipeline cache data." << std::endl;
+    return;
+  }
+
+  FileHeader header{};
+  header.magic = FILE_MAGIC;
+  header.version = FILE_VERSION;
+  header.baselineCount = static_cast<u32>(mBaselines.size());
+  header.dataSize = size;
+
+  // Other programs may be reading the file right now; they see either the
+  // old or the new contents.
+  str temporaryPath = mPath + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    for (auto const &baseline : mBaselines) {
+      FileBaseline entry{};
+      std::strncpy(entry.program, baseline.program.c_str(),
+                   PROGRAM_NAME_SIZE - 1);
+      entry.nanoseconds = static_cast<u64>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              baseline.creationTime)
+              .count());
+      file.write(reinterpret_cast<char const *>(&entry), sizeof(entry));
+    }
+    file.write(data.data(), static_cast<std::streamsize>(size));
+    if (!file) {
+      std::cerr << "WARNING: Failed to write pipeline cache file."
+                << std::endl;
+      return;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporaryPath, mPath, error);
+  if (error) {
+    std::cerr << "WARNING: Failed to replace pipeline cache file: "
+              << error.message() << std::endl;
+  }
+}
+
+VkResult
+PipelineCache::createGraphicsPipeline(VkGraphicsPipelineCreateInfo const &info,
+                                      VkAllocationCallbacks const *allocator,
+                                      VkPipeline *pipeline) {
+  Clock::time_point start = Clock::now();
+  VkResult result = vkCreateGraphicsPipelines(mDevice, mCache, 1, &info,
+                                              allocator, pipeline);
+  Clock::duration elapsed = Clock::now() - start;
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  mCreationTime += elapsed;
+  ++mPipelineCount;
+  return result;
+}
+
+VkResult
+PipelineCache::createComputePipeline(VkComputePipelineCreateInfo const &info,
+                                     VkAllocationCallbacks const *allocator,
+                                     VkPipeline *pipeline) {
+  Clock::time_point start = Clock::now();
+  VkResult result =
+      vkCreateComputePipelines(mDevice, mCache, 1, &info, allocator, pipeline);
+  Clock::duration elapsed = Clock::now() - start;
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  mCreationTime += elapsed;
+  ++mPipelineCount;
+  return result;
+}
+
+void PipelineCache::log(std::ostream &stream) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  stream << std::fixed << std::setprecision(2) << "[PipelineCache] "
+         << (mWarm ? "warm" : "cold") << " start for " << mProgram << ": "
+         << mPipelineCount << " pipelines in "
+         << toMilliseconds(mCreationTime) << " ms";
+
+  auto it = std::find_if(mBaselines.begin(), mBaselines.end(),
+                         [this](Baseline const &baseline) {
+                           return baseline.program == mProgram;
+                         });
+  if (mWarm && it != mBaselines.end()) {
+    stream << ", " << toMilliseconds(it->creationTime) << " ms cold (saved "
+           << toMilliseconds(it->creationTime - mCreationTime) << " ms)";
+  }
+  stream << ", " << mLoadedSize / 1024 << " KiB loaded" << std::defaultfloat
+         << std::endl;
+}
+
+} // namespace VulkanTutorial
@@ -0,0 +1,192 @@
+#include <pipeline_manager.hpp>
+
+namespace VulkanTutorial {
+
+u64 PipelineKey::pack() const {
+  static_assert(sizeof(PipelineKey) == sizeof(u64));
+  u64 packed;
+  std::memcpy(&packed, this, sizeof(packed));
+  return packed;
+}
+
+void PipelineManager::init(VkDevice device,
+                           VkAllocationCallbacks const *allocator,
+                           u32 threadCount, PipelineTarget const &target,
+                           PipelineBuilder builder) {
+  mDevice = device;
+  mAllocator = allocator;
+  mTarget = target;
+  mBuilder = std::move(builder);
+
+  mThreads.reserve(threadCount);
+  for (u32 i = 0; i < threadCount; ++i) {
+    mThreads.emplace_back([this]() { this->compileLoop(); });
+  }
+}
+
+void PipelineManager::destroy() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+    mPending.clear();
+  }
+  mWorkReady.notify_all();
+  for (auto &thread : mThreads) {
+    thread.join();
+  }
+  mThreads.clear();
+  mStopping = false;
+
+  for (auto const &[packed, entry] : mEntries) {
+    if (entry.pipeline != VK_NULL_HANDLE) {
+      vkDestroyPipeline(mDevice, entry.pipeline, mAllocator);
+    }
+  }
+  mEntries.clear();
+}
+
+void PipelineManager::setTarget(PipelineTarget const &target) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mTarget = target;
+}
+
+std::exception_ptr PipelineManager::compile(Job const &job) {
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  std::exception_ptr error;
+  Clock::time_point start = Clock::now();
+  try {
+    pipeline = mBuilder(job.key, job.target);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  Clock::duration elapsed = Clock::now() - start;
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Entry &entry = mEntries[job.key.pack()];
+    entry.pipeline = pipeline;
+    entry.ready = true;
+    entry.error = error;
+    mCompileTime += elapsed;
+  }
+  mCompiled.notify_all();
+  return error;
+}
+
+void PipelineManager::compileLoop() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mWorkReady.wait(lock,
+                      [this]() { return mStopping || !mPending.empty(); });
+      if (mStopping) {
+        return;
+      }
+      job = mPending.front();
+      mPending.pop_front();
+      ++mBackgroundCompiles;
+    }
+
+    std::exception_ptr error = this->compile(job);
+    if (error) {
+      try {
+        std::rethrow_exception(error);
+      } catch (std::exception const &exception) {
+        std::cerr << "WARNING: Pipeline permutation " << std::hex
+                  << job.key.pack() << std::dec
+                  << " failed to compile: " << exception.what() << std::endl;
+      } catch (...) {
+        std::cerr << "WARNING: Pipeline permutation " << std::hex
+                  << job.key.pack() << std::dec << " failed to compile."
+                  << std::endl;
+      }
+    }
+  }
+}
+
+bool PipelineManager::isReady(PipelineKey const &key) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto it = mEntries.find(key.pack());
+  return it != mEntries.end() && it->second.ready;
+}
+
+VkPipeline PipelineManager::require(PipelineKey const &key) {
+  Job job{key, {}};
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto [it, inserted] = mEntries.try_emplace(key.pack());
+    if (!inserted) {
+      // Already queued or compiling elsewhere; take that result. Rehashing
+      // keeps references valid, iterators not.
+      Entry &entry = it->second;
+      mCompiled.wait(lock, [&]() { return entry.ready; });
+      if (entry.error) {
+        std::rethrow_exception(entry.error);
+      }
+      return entry.pipeline;
+    }
+    job.target = mTarget;
+  }
+
+  std::exception_ptr error = this->compile(job);
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mEntries[key.pack()].pipeline;
+}
+
+VkPipeline PipelineManager::get(PipelineKey const &key,
+                                PipelineKey const &fallback) {
+  bool queued = false;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto [it, inserted] = mEntries.try_emplace(key.pack());
+    if (inserted) {
+      mPending.push_back({key, mTarget});
+      queued = true;
+    }
+    // A permutation that failed to compile keeps using the fallback.
+    if (it->second.pipeline != VK_NULL_HANDLE) {
+      pipeline = it->second.pipeline;
+    } else {
+      ++mFallbackRequests;
+      pipeline = mEntries[fallback.pack()].pipeline;
+    }
+  }
+
+  if (queued) {
+    mWorkReady.notify_one();
+  }
+  return pipeline;
+}
+
+void PipelineManager::prefetch(PipelineKey const &key) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mEntries.try_emplace(key.pack()).second) {
+      return;
+    }
+    mPending.push_back({key, mTarget});
+  }
+  mWorkReady.notify_one();
+}
+
+void PipelineManager::log(std::ostream &stream) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  u64 ready = 0;
+  for (auto const &[packed, entry] : mEntries) {
+    ready += entry.pipeline != VK_NULL_HANDLE ? 1 : 0;
+  }
+  stream << std::fixed << std::setprecision(2) << "[Pipelines] " << ready
+         << " permutations compiled (" << mBackgroundCompiles
+         << " in the background) in "
+         << std::chrono::duration<double, std::milli>(mCompileTime).count()
+         << " ms, " << mFallbackRequests << " fallback draws"
+         << std::defaultfloat << std::endl;
+}
+
+} // namespace VulkanTutorial
@@ -0,0 +1,131 @@
+#include <present_thread.hpp>
+
+namespace VulkanTutorial {
+
+void PresentThread::init(VkQueue queue, bool threaded) {
+  mQueue = queue;
+  mResult = VK_SUCCESS;
+  mPresents = 0;
+  mBlocked = {};
+  if (threaded) {
+    mThread = std::thread([this]() { this->presentLoop(); });
+  }
+}
+
+void PresentThread::destroy() {
+  if (!mThread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mWorkReady.notify_all();
+  mThread.join();
+  mPending.clear();
+  mStopping = false;
+}
+
+void PresentThread::present(PresentRequest const &request) {
+  VkPresentInfoKHR presentInfo{};
+  presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+  presentInfo.waitSemaphoreCount = 1;
+  presentInfo.pWaitSemaphores = &request.waitSemaphore;
+  presentInfo.swapchainCount = 1;
+  presentInfo.pSwapchains = &request.swapchain;
+  presentInfo.pImageIndices = &request.imageIndex;
+
+  Clock::time_point start = Clock::now();
+  VkResult result;
+  {
+    std::lock_guard<std::mutex> lock(mQueueMutex);
+    result = vkQueuePresentKHR(mQueue, &presentInfo);
+  }
+  Clock::duration blocked = Clock::now() - start;
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  ++mPresents;
+  mBlocked += blocked;
+  // Errors outrank out of date, which outranks suboptimal.
+  if (result != VK_SUCCESS &&
+      (mResult == VK_SUCCESS || mResult == VK_SUBOPTIMAL_KHR)) {
+    mResult = result;
+  }
+}
+
+void PresentThread::presentLoop() {
+  while (true) {
+    PresentRequest request;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mWorkReady.wait(lock,
+                      [this]() { return mStopping || !mPending.empty(); });
+      // Requests still queued on shutdown are dropped; the swapchain is about
+      // to go away.
+      if (mStopping) {
+        return;
+      }
+      request = mPending.front();
+      mPending.pop_front();
+      mPresenting = true;
+    }
+
+    this->present(request);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPresenting = false;
+    if (mPending.empty()) {
+      mIdle.notify_all();
+    }
+  }
+}
+
+void PresentThread::push(PresentRequest const &request) {
+  if (!this->isThreaded()) {
+    this->present(request);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPending.push_back(request);
+  }
+  mWorkReady.notify_one();
+}
+
+bool PresentThread::poll() {
+  VkResult result;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    result = mResult;
+    mResult = VK_SUCCESS;
+  }
+
+  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+    return true;
+  } else if (result != VK_SUCCESS) {
+    throw std::runtime_error("Failed to present swap chain image.");
+  }
+  return false;
+}
+
+void PresentThread::drain() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mIdle.wait(lock, [this]() { return mPending.empty() && !mPresenting; });
+}
+
+void PresentThread::log(std::ostream &stream) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  double blocked = std::chrono::duration<double, std::milli>(mBlocked).count();
+  stream << std::fixed << std::setprecision(2) << "[Present] " << mPresents
+         << (this->isThreaded() ? " presents on a present thread"
+                                : " presents on the render thread");
+  if (mPresents > 0) {
+    stream << ", avg " << blocked / static_cast<double>(mPresents)
+           << " ms blocked";
+  }
+  stream << std::defaultfloat << std::endl;
+}
+
+} // namespace VulkanTutorial
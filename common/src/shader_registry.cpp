@@ -0,0 +1,24 @@
+#include <shader_registry.hpp>
+
+namespace VulkanTutorial {
+
+ShaderRegistry &ShaderRegistry::get() {
+  static ShaderRegistry instance;
+  return instance;
+}
+
+bool ShaderRegistry::add(char const *name, u32 const *code, size_t size) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mShaders.emplace(name, ShaderCode{code, size}).second;
+}
+
+ShaderCode ShaderRegistry::find(str const &name) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto it = mShaders.find(name);
+  if (it == mShaders.end()) {
+    throw std::runtime_error("Failed to find embedded shader module.");
+  }
+  return it->second;
+}
+
+} // namespace VulkanTutorial
@@ -0,0 +1,215 @@
+#include <submit_scheduler.hpp>
+
+namespace VulkanTutorial {
+
+namespace {
+VkPipelineStageFlags toLegacyStages(VkPipelineStageFlags2 stages) {
+  // The legacy bits share their values with the first 32 bits of the new
+  // flags; anything newer is widened to all commands.
+  if (stages == VK_PIPELINE_STAGE_2_NONE || (stages >> 32) != 0) {
+    return VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  }
+  return static_cast<VkPipelineStageFlags>(stages);
+}
+} // namespace
+
+void SubmitScheduler::init(bool useSynchronization2) {
+  mUseSynchronization2 = useSynchronization2;
+  mCalls.clear();
+  mSubmitCalls = 0;
+  mBatches = 0;
+}
+
+SubmitScheduler::Call &SubmitScheduler::getCall(VkQueue queue,
+                                                size_t first) {
+  for (size_t i = mCalls.size(); i-- > first;) {
+    if (mCalls[i].queue == queue) {
+      if (mCalls[i].fence == VK_NULL_HANDLE) {
+        return mCalls[i];
+      }
+      break;
+    }
+  }
+
+  Call &call = mCalls.emplace_back();
+  call.queue = queue;
+  return call;
+}
+
+SubmitScheduler::Batch &
+SubmitScheduler::getBatch(VkQueue queue, bool forWait, size_t first) {
+  Call &call = this->getCall(queue, first);
+  if (call.batches.empty()) {
+    return call.batches.emplace_back();
+  }
+
+  Batch &batch = call.batches.back();
+  bool started = forWait && !batch.commandBuffers.empty();
+  if (started || !batch.signals.empty()) {
+    return call.batches.emplace_back();
+  }
+  return batch;
+}
+
+size_t SubmitScheduler::findCallAfterSignal(VkSemaphore semaphore) const {
+  for (size_t i = mCalls.size(); i-- > 0;) {
+    for (auto const &batch : mCalls[i].batches) {
+      for (auto const &signal : batch.signals) {
+        if (signal.semaphore == semaphore) {
+          return i + 1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+void SubmitScheduler::wait(VkQueue queue, VkSemaphore semaphore,
+                           VkPipelineStageFlags2 stages, u64 value) {
+  VkSemaphoreSubmitInfo info{};
+  info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+  info.semaphore = semaphore;
+  info.value = value;
+  info.stageMask = stages;
+
+  // Waiting in the signaling call itself is fine, as its batches are
+  // submitted in order; an earlier call on this queue would run first.
+  size_t first = this->findCallAfterSignal(semaphore);
+  if (first > 0 && mCalls[first - 1].queue == queue) {
+    --first;
+  }
+  this->getBatch(queue, true, first).waits.push_back(info);
+}
+
+void SubmitScheduler::add(VkQueue queue, VkCommandBuffer commandBuffer) {
+  VkCommandBufferSubmitInfo info{};
+  info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+  info.commandBuffer = commandBuffer;
+  this->getBatch(queue, false).commandBuffers.push_back(info);
+}
+
+void SubmitScheduler::signal(VkQueue queue, VkSemaphore semaphore,
+                             VkPipelineStageFlags2 stages, u64 value) {
+  VkSemaphoreSubmitInfo info{};
+  info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+  info.semaphore = semaphore;
+  info.value = value;
+  info.stageMask = stages;
+
+  // Signals join the current batch even after other signals.
+  Call &call = this->getCall(queue);
+  if (call.batches.empty()) {
+    call.batches.emplace_back();
+  }
+  call.batches.back().signals.push_back(info);
+}
+
+void SubmitScheduler::fence(VkQueue queue, VkFence fence) {
+  this->getCall(queue).fence = fence;
+}
+
+void SubmitScheduler::flush() {
+  for (auto const &call : mCalls) {
+    if (mUseSynchronization2) {
+      this->submit2(call);
+    } else {
+      this->submitLegacy(call);
+    }
+    ++mSubmitCalls;
+    mBatches += call.batches.size();
+  }
+  mCalls.clear();
+}
+
+void SubmitScheduler::submit2(Call const &call) {
+  vec<VkSubmitInfo2> submits(call.batches.size());
+  for (u32 i = 0; i < submits.size(); ++i) {
+    Batch const &batch = call.batches[i];
+    submits[i].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    submits[i].waitSemaphoreInfoCount = static_cast<u32>(batch.waits.size());
+    submits[i].pWaitSemaphoreInfos = batch.waits.data();
+    submits[i].commandBufferInfoCount =
+        static_cast<u32>(batch.commandBuffers.size());
+    submits[i].pCommandBufferInfos = batch.commandBuffers.data();
+    submits[i].signalSemaphoreInfoCount =
+        static_cast<u32>(batch.signals.size());
+    submits[i].pSignalSemaphoreInfos = batch.signals.data();
+  }
+
+  if (vkQueueSubmit2(call.queue, static_cast<u32>(submits.size()),
+                     submits.data(), call.fence) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to submit queue work.");
+  }
+}
+
+void SubmitScheduler::submitLegacy(Call const &call) {
+  struct LegacyBatch {
+    vec<VkSemaphore> waits;
+    vec<u64> waitValues;
+    vec<VkPipelineStageFlags> waitStages;
+    vec<VkCommandBuffer> commandBuffers;
+    vec<VkSemaphore> signals;
+    vec<u64> signalValues;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  };
+
+  // Every array is filled before any pointer into it is taken.
+  vec<LegacyBatch> batches(call.batches.size());
+  vec<VkSubmitInfo> submits(call.batches.size());
+  for (u32 i = 0; i < submits.size(); ++i) {
+    Batch const &batch = call.batches[i];
+    LegacyBatch &legacy = batches[i];
+    for (auto const &wait : batch.waits) {
+      legacy.waits.push_back(wait.semaphore);
+      legacy.waitValues.push_back(wait.value);
+      legacy.waitStages.push_back(toLegacyStages(wait.stageMask));
+    }
+    for (auto const &info : batch.commandBuffers) {
+      legacy.commandBuffers.push_back(info.commandBuffer);
+    }
+    for (auto const &signal : batch.signals) {
+      legacy.signals.push_back(signal.semaphore);
+      legacy.signalValues.push_back(signal.value);
+    }
+
+    // Binary semaphores ignore their values, so the values are only passed
+    // along when there is a timeline semaphore to use them.
+    bool hasValues =
+        std::any_of(legacy.waitValues.begin(), legacy.waitValues.end(),
+                    [](u64 value) { return value != 0; }) ||
+        std::any_of(legacy.signalValues.begin(), legacy.signalValues.end(),
+                    [](u64 value) { return value != 0; });
+    legacy.timelineInfo.sType =
+        VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    legacy.timelineInfo.waitSemaphoreValueCount =
+        static_cast<u32>(legacy.waitValues.size());
+    legacy.timelineInfo.pWaitSemaphoreValues = legacy.waitValues.data();
+    legacy.timelineInfo.signalSemaphoreValueCount =
+        static_cast<u32>(legacy.signalValues.size());
+    legacy.timelineInfo.pSignalSemaphoreValues = legacy.signalValues.data();
+
+    submits[i].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submits[i].pNext = hasValues ? &legacy.timelineInfo : nullptr;
+    submits[i].waitSemaphoreCount = static_cast<u32>(legacy.waits.size());
+    submits[i].pWaitSemaphores = legacy.waits.data();
+    submits[i].pWaitDstStageMask = legacy.waitStages.data();
+    submits[i].commandBufferCount =
+        static_cast<u32>(legacy.commandBuffers.size());
+    submits[i].pCommandBuffers = legacy.commandBuffers.data();
+    submits[i].signalSemaphoreCount = static_cast<u32>(legacy.signals.size());
+    submits[i].pSignalSemaphores = legacy.signals.data();
+  }
+
+  if (vkQueueSubmit(call.queue, static_cast<u32>(submits.size()),
+                    submits.data(), call.fence) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to submit queue work.");
+  }
+}
+
+void SubmitScheduler::log(std::ostream &stream) const {
+  stream << "[Submit] " << mBatches << " batches in " << mSubmitCalls
+         << (mUseSynchronization2 ? " vkQueueSubmit2" : " vkQueueSubmit")
+         << " calls" << std::endl;
+}
+
+} // namespace VulkanTutorial
@@ -0,0 +1,87 @@
+#include <uniform_ring.hpp>
+#include <util.hpp>
+
+namespace VulkanTutorial {
+
+namespace {
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+void UniformRing::init(VkPhysicalDevice physicalDevice, VkDevice device,
+                       MemoryTracker *tracker, VkDeviceSize frameSize,
+                       u32 frameCount) {
+  mDevice = device;
+  mTracker = tracker;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  mAlignment = std::max<VkDeviceSize>(
+      properties.limits.minUniformBufferOffsetAlignment, 1);
+  mFrameSize = alignUp(frameSize, mAlignment);
+  mFrameCount = frameCount;
+
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = mFrameSize * mFrameCount;
+  bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  if (vkCreateBuffer(mDevice, &bufferInfo, mTracker->getAllocator(),
+                     &mBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create uniform ring buffer.");
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(mDevice, mBuffer, &memRequirements);
+
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = memRequirements.size;
+  allocInfo.memoryTypeIndex = Util::findMemoryType(
+      physicalDevice, memRequirements.memoryTypeBits,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  if (mTracker->allocate(allocInfo, MemoryCategory::UNIFORM, &mMemory) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate uniform ring memory.");
+  }
+
+  vkBindBufferMemory(mDevice, mBuffer, mMemory, 0);
+  vkMapMemory(mDevice, mMemory, 0, bufferInfo.size, 0,
+              reinterpret_cast<void **>(&mMapped));
+}
+
+void UniformRing::destroy() {
+  if (mBuffer == VK_NULL_HANDLE) {
+    return;
+  }
+
+  vkUnmapMemory(mDevice, mMemory);
+  vkDestroyBuffer(mDevice, mBuffer, mTracker->getAllocator());
+  mTracker->free(mMemory);
+  mBuffer = VK_NULL_HANDLE;
+  mMemory = VK_NULL_HANDLE;
+  mMapped = nullptr;
+}
+
+void UniformRing::beginFrame(u32 frameIndex) {
+  mFrameBegin = mFrameSize * (frameIndex % mFrameCount);
+  mHead = mFrameBegin;
+}
+
+UniformAllocation UniformRing::allocate(VkDeviceSize size) {
+  VkDeviceSize offset = mHead;
+  VkDeviceSize end = offset + alignUp(size, mAlignment);
+  if (end > mFrameBegin + mFrameSize) {
+    throw std::runtime_error("Uniform ring frame region is full.");
+  }
+
+  mHead = end;
+  mPeakUsage = std::max(mPeakUsage, mHead - mFrameBegin);
+  return {static_cast<u32>(offset), mMapped + offset};
+}
+
+} // namespace VulkanTutorial
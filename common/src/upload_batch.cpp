@@ -0,0 +1,415 @@
+#include <upload_batch.hpp>
+
+namespace VulkanTutorial {
+
+void UploadBatch::BarrierBatch::record(VkCommandBuffer commandBuffer) const {
+  if (this->empty()) {
+    return;
+  }
+
+  vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr,
+                       static_cast<u32>(buffers.size()), buffers.data(),
+                       static_cast<u32>(images.size()), images.data());
+}
+
+void UploadBatch::BarrierBatch::clear() {
+  srcStages = 0;
+  dstStages = 0;
+  buffers.clear();
+  images.clear();
+}
+
+void UploadBatch::init(VkDevice device, VkAllocationCallbacks const *allocator,
+                       DeletionQueue *deletionQueue,
+                       SubmitScheduler *scheduler, UploadQueue const &graphics,
+                       UploadQueue const &transfer) {
+  mDevice = device;
+  mAllocator = allocator;
+  mDeletionQueue = deletionQueue;
+  mScheduler = scheduler;
+  mGraphics = graphics;
+  mTransfer = transfer;
+  mDedicatedTransfer = transfer.queue != VK_NULL_HANDLE &&
+                       transfer.family != graphics.family;
+}
+
+VkCommandBuffer UploadBatch::beginCommands(UploadQueue const &queue) {
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandPool = queue.commandPool;
+  allocInfo.commandBufferCount = 1;
+
+  VkCommandBuffer commandBuffer;
+  if (vkAllocateCommandBuffers(mDevice, &allocInfo, &commandBuffer) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate upload command buffer.");
+  }
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+  return commandBuffer;
+}
+
+void UploadBatch::handOver(VkBufferMemoryBarrier barrier,
+                           VkPipelineStageFlags dstStage) {
+  mPostCopy.srcStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+  if (!mDedicatedTransfer) {
+    mPostCopy.dstStages |= dstStage;
+    mPostCopy.buffers.push_back(barrier);
+    return;
+  }
+
+  // Release on the transfer queue, acquire on the graphics queue. The
+  // graphics submission waits on the transfer semaphore at dstStage, which
+  // chains the wait into the acquire.
+  barrier.srcQueueFamilyIndex = mTransfer.family;
+  barrier.dstQueueFamilyIndex = mGraphics.family;
+  VkBufferMemoryBarrier release = barrier;
+  release.dstAccessMask = 0;
+  mPostCopy.dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  mPostCopy.buffers.push_back(release);
+
+  barrier.srcAccessMask = 0;
+  mAcquire.srcStages |= dstStage;
+  mAcquire.dstStages |= dstStage;
+  mAcquire.buffers.push_back(barrier);
+}
+
+void UploadBatch::handOver(VkImageMemoryBarrier barrier,
+                           VkPipelineStageFlags dstStage) {
+  mPostCopy.srcStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+  if (!mDedicatedTransfer) {
+    mPostCopy.dstStages |= dstStage;
+    mPostCopy.images.push_back(barrier);
+    return;
+  }
+
+  barrier.srcQueueFamilyIndex = mTransfer.family;
+  barrier.dstQueueFamilyIndex = mGraphics.family;
+  VkImageMemoryBarrier release = barrier;
+  release.dstAccessMask = 0;
+  mPostCopy.dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  mPostCopy.images.push_back(release);
+
+  barrier.srcAccessMask = 0;
+  mAcquire.srcStages |= dstStage;
+  mAcquire.dstStages |= dstStage;
+  mAcquire.images.push_back(barrier);
+}
+
+void UploadBatch::copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size,
+                             VkAccessFlags dstAccess,
+                             VkPipelineStageFlags dstStage) {
+  BufferCopy copy{};
+  copy.src = src;
+  copy.dst = dst;
+  copy.region.srcOffset = 0;
+  copy.region.dstOffset = 0;
+  copy.region.size = size;
+  mBufferCopies.push_back(copy);
+
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = dstAccess;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = dst;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+  this->handOver(barrier, dstStage);
+
+  ++mOperations;
+}
+
+void UploadBatch::copyBufferToImage(VkBuffer buffer, VkImage image,
+                                    VkExtent2D extent, u32 mipLevels) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = mipLevels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  mPreCopy.srcStages |= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  mPreCopy.dstStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+  mPreCopy.images.push_back(barrier);
+
+  ImageCopy copy{};
+  copy.src = buffer;
+  copy.dst = image;
+  copy.region.bufferOffset = 0;
+  copy.region.bufferRowLength = 0;
+  copy.region.bufferImageHeight = 0;
+  copy.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  copy.region.imageSubresource.mipLevel = 0;
+  copy.region.imageSubresource.baseArrayLayer = 0;
+  copy.region.imageSubresource.layerCount = 1;
+  copy.region.imageOffset = {0, 0, 0};
+  copy.region.imageExtent = {extent.width, extent.height, 1};
+  mImageCopies.push_back(copy);
+
+  // Mip generation blits on the graphics queue, so every level is handed over
+  // still in TRANSFER_DST.
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask =
+      VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  this->handOver(barrier, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+  ++mOperations;
+}
+
+void UploadBatch::transitionImage(VkImageMemoryBarrier const &barrier,
+                                  VkPipelineStageFlags srcStage,
+                                  VkPipelineStageFlags dstStage) {
+  mAcquire.srcStages |= srcStage;
+  mAcquire.dstStages |= dstStage;
+  mAcquire.images.push_back(barrier);
+  ++mOperations;
+}
+
+void UploadBatch::generateMipmaps(VkImage image, VkExtent2D extent,
+                                  u32 mipLevels) {
+  mMipChains.push_back({image, extent, mipLevels});
+  ++mOperations;
+}
+
+void UploadBatch::retire(DeletionCallback const &destroy) {
+  mCleanup.push_back(destroy);
+}
+
+void UploadBatch::recordMipChain(VkCommandBuffer commandBuffer,
+                                 MipChain const &chain) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.image = chain.image;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.subresourceRange.levelCount = 1;
+
+  i32 mipWidth = static_cast<i32>(chain.extent.width);
+  i32 mipHeight = static_cast<i32>(chain.extent.height);
+
+  for (u32 i = 1; i < chain.mipLevels; ++i) {
+    barrier.subresourceRange.baseMipLevel = i - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+
+    VkImageBlit blit{};
+    blit.srcOffsets[0] = {0, 0, 0};
+    blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.mipLevel = i - 1;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = 1;
+    blit.dstOffsets[0] = {0, 0, 0};
+    blit.dstOffsets[1] = {mipWidth > 1 ? mipWidth / 2 : 1,
+                          mipHeight > 1 ? mipHeight / 2 : 1, 1};
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.mipLevel = i;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount = 1;
+
+    vkCmdBlitImage(commandBuffer, chain.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, chain.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &barrier);
+
+    if (mipWidth > 1)
+      mipWidth /= 2;
+    if (mipHeight > 1)
+      mipHeight /= 2;
+  }
+
+  barrier.subresourceRange.baseMipLevel = chain.mipLevels - 1;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+}
+
+UploadToken UploadBatch::submit() {
+  if (this->isEmpty()) {
+    return {};
+  }
+
+  bool hasCopies = !mBufferCopies.empty() || !mImageCopies.empty();
+  VkCommandBuffer transferCommands = VK_NULL_HANDLE;
+  VkSemaphore transferDone = VK_NULL_HANDLE;
+  VkCommandBuffer graphicsCommands = this->beginCommands(mGraphics);
+
+  VkCommandBuffer copyCommands = graphicsCommands;
+  if (mDedicatedTransfer && hasCopies) {
+    transferCommands = this->beginCommands(mTransfer);
+    copyCommands = transferCommands;
+  }
+
+  mPreCopy.record(copyCommands);
+  for (auto const &copy : mBufferCopies) {
+    vkCmdCopyBuffer(copyCommands, copy.src, copy.dst, 1, &copy.region);
+  }
+  for (auto const &copy : mImageCopies) {
+    vkCmdCopyBufferToImage(copyCommands, copy.src, copy.dst,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                           &copy.region);
+  }
+  mPostCopy.record(copyCommands);
+
+  if (transferCommands != VK_NULL_HANDLE) {
+    vkEndCommandBuffer(transferCommands);
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    if (vkCreateSemaphore(mDevice, &semaphoreInfo, mAllocator,
+                          &transferDone) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create upload semaphore.");
+    }
+
+    mScheduler->add(mTransfer.queue, transferCommands);
+    mScheduler->signal(mTransfer.queue, transferDone,
+                       VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT);
+    ++mStats.submissions;
+  }
+
+  mAcquire.record(graphicsCommands);
+  for (auto const &chain : mMipChains) {
+    this->recordMipChain(graphicsCommands, chain);
+  }
+  vkEndCommandBuffer(graphicsCommands);
+
+  VkFence fence = VK_NULL_HANDLE;
+  if (!mDeletionQueue->hasTimeline()) {
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(mDevice, &fenceInfo, mAllocator, &fence) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("Failed to create upload fence.");
+    }
+  }
+
+  UploadToken token{mDeletionQueue->registerSubmission()};
+  if (transferDone != VK_NULL_HANDLE) {
+    // The legacy stage bits are valid VkPipelineStageFlags2 values.
+    mScheduler->wait(mGraphics.queue, transferDone, mAcquire.dstStages);
+  }
+  mScheduler->add(mGraphics.queue, graphicsCommands);
+  if (mDeletionQueue->hasTimeline()) {
+    mScheduler->signal(mGraphics.queue, mDeletionQueue->getTimeline(),
+                       VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, token.submission);
+  }
+  if (fence != VK_NULL_HANDLE) {
+    mScheduler->fence(mGraphics.queue, fence);
+  }
+  ++mStats.submissions;
+
+  // Later graphics submissions are ordered after this one, so nothing has to
+  // wait here. The transfer half can only be done once the graphics half is,
+  // so everything is released against the graphics submission.
+  if (fence != VK_NULL_HANDLE) {
+    mDeletionQueue->watch(token.submission, fence);
+  }
+  mDeletionQueue->retire(
+      token.submission, [device = mDevice, allocator = mAllocator,
+                         graphics = mGraphics, transfer = mTransfer,
+                         graphicsCommands, transferCommands, transferDone,
+                         fence]() {
+        vkFreeCommandBuffers(device, graphics.commandPool, 1,
+                             &graphicsCommands);
+        if (transferCommands != VK_NULL_HANDLE) {
+          vkFreeCommandBuffers(device, transfer.commandPool, 1,
+                               &transferCommands);
+          vkDestroySemaphore(device, transferDone, allocator);
+        }
+        if (fence != VK_NULL_HANDLE) {
+          vkDestroyFence(device, fence, allocator);
+        }
+      });
+  for (auto const &destroy : mCleanup) {
+    mDeletionQueue->retire(token.submission, destroy);
+  }
+
+  mStats.operations += mOperations;
+  this->clear();
+  return token;
+}
+
+bool UploadBatch::isComplete(UploadToken const &token) const {
+  return mDeletionQueue->isComplete(token.submission);
+}
+
+void UploadBatch::wait(UploadToken const &token) {
+  if (!token.isValid() || this->isComplete(token)) {
+    return;
+  }
+
+  // The batch may still be queued on the scheduler. Its fence stays watched
+  // until the deletion queue has seen it signal, so without a timeline there
+  // is always something to wait on.
+  if (!mScheduler->isEmpty()) {
+    mScheduler->flush();
+  }
+  mDeletionQueue->wait(token.submission);
+  ++mStats.waits;
+}
+
+void UploadBatch::discard() {
+  // Nothing was recorded yet, so the resources can go right away.
+  for (auto const &destroy : mCleanup) {
+    destroy();
+  }
+  this->clear();
+}
+
+void UploadBatch::clear() {
+  mPreCopy.clear();
+  mBufferCopies.clear();
+  mImageCopies.clear();
+  mPostCopy.clear();
+  mAcquire.clear();
+  mMipChains.clear();
+  mCleanup.clear();
+  mOperations = 0;
+}
+
+void UploadBatch::log(std::ostream &stream) const {
+  stream << "[UploadBatch] " << mStats.operations << " operations in "
+         << mStats.submissions << " submissions, saved "
+         << mStats.getSavedSubmissions() << " submissions and "
+         << mStats.getSavedWaits() << " queue waits" << std::endl;
+}
+
+} // namespace VulkanTutorial
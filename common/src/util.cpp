@@ -45,4 +45,109 @@ vec<char> readFile(str const &filename) {
 
   return buffer;
 }
+
+bool isDeviceExtensionSupported(VkPhysicalDevice device,
+                                char const *extensionName) {
+  u32 extensionCount;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                       nullptr);
+
+  vec<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                       availableExtensions.data());
+
+  for (auto const &extension : availableExtensions) {
+    if (std::strcmp(extension.extensionName, extensionName) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool isTimelineSemaphoreSupported(VkPhysicalDevice device) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(device, &properties);
+  if (properties.apiVersion < VK_API_VERSION_1_2) {
+    return false;
+  }
+
+  VkPhysicalDeviceVulkan12Features features12{};
+  features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceFeatures2 features{};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &features12;
+  vkGetPhysicalDeviceFeatures2(device, &features);
+
+  return features12.timelineSemaphore == VK_TRUE;
+}
+
+namespace {
+// All false when the device does not support Vulkan 1.3.
+VkPhysicalDeviceVulkan13Features getVulkan13Features(VkPhysicalDevice device) {
+  VkPhysicalDeviceVulkan13Features features13{};
+  features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(device, &properties);
+  if (properties.apiVersion < VK_API_VERSION_1_3) {
+    return features13;
+  }
+
+  VkPhysicalDeviceFeatures2 features{};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &features13;
+  vkGetPhysicalDeviceFeatures2(device, &features);
+  features13.pNext = nullptr;
+  return features13;
+}
+} // namespace
+
+bool isSynchronization2Supported(VkPhysicalDevice device) {
+  return getVulkan13Features(device).synchronization2 == VK_TRUE;
+}
+
+bool isDynamicRenderingSupported(VkPhysicalDevice device) {
+  return getVulkan13Features(device).dynamicRendering == VK_TRUE;
+}
+
+bool isExtendedDynamicStateSupported(VkPhysicalDevice device) {
+  // The state of VK_EXT_extended_dynamic_state and the core part of
+  // VK_EXT_extended_dynamic_state2 are required by Vulkan 1.3.
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(device, &properties);
+  return properties.apiVersion >= VK_API_VERSION_1_3;
+}
+
+bool isDynamicColorBlendEnableSupported(VkPhysicalDevice device) {
+  if (!isDeviceExtensionSupported(
+          device, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)) {
+    return false;
+  }
+
+  VkPhysicalDeviceExtendedDynamicState3FeaturesEXT features3{};
+  features3.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+  VkPhysicalDeviceFeatures2 features{};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &features3;
+  vkGetPhysicalDeviceFeatures2(device, &features);
+
+  return features3.extendedDynamicState3ColorBlendEnable == VK_TRUE;
+}
+
+u32 findMemoryType(VkPhysicalDevice physicalDevice, u32 typeFilter,
+                   VkMemoryPropertyFlags properties) {
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+  for (u32 i = 0; i < memProperties.memoryTypeCount; ++i) {
+    if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags &
+                                    properties) == properties) {
+      return i;
+    }
+  }
+
+  throw std::runtime_error("Failed to find suitable memory type.");
+}
 } // namespace VulkanTutorial::Util
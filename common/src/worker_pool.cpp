@@ -0,0 +1,92 @@
+#include <worker_pool.hpp>
+
+namespace VulkanTutorial {
+
+void WorkerPool::init(u32 threadCount) {
+  mThreads.reserve(threadCount);
+  for (u32 i = 0; i < threadCount; ++i) {
+    mThreads.emplace_back([this, i]() { this->workerLoop(i); });
+  }
+}
+
+void WorkerPool::destroy() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mWorkReady.notify_all();
+
+  for (auto &thread : mThreads) {
+    thread.join();
+  }
+  mThreads.clear();
+  mStopping = false;
+}
+
+void WorkerPool::workerLoop(u32 index) {
+  u64 seenGeneration = 0;
+  while (true) {
+    WorkerTask const *task = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mWorkReady.wait(lock, [&]() {
+        return mStopping || mGeneration != seenGeneration;
+      });
+      if (mStopping) {
+        return;
+      }
+      seenGeneration = mGeneration;
+      if (index >= mTaskCount) {
+        continue;
+      }
+      task = mTask;
+    }
+
+    try {
+      (*task)(index);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (!mError) {
+        mError = std::current_exception();
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (--mRemaining == 0) {
+      mWorkDone.notify_one();
+    }
+  }
+}
+
+void WorkerPool::run(u32 taskCount, WorkerTask const &task) {
+  if (taskCount == 0) {
+    return;
+  }
+  if (taskCount > this->getThreadCount()) {
+    throw std::runtime_error("More tasks than worker threads.");
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTask = &task;
+    mTaskCount = taskCount;
+    mRemaining = taskCount;
+    mError = nullptr;
+    ++mGeneration;
+  }
+  mWorkReady.notify_all();
+
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mWorkDone.wait(lock, [this]() { return mRemaining == 0; });
+    mTask = nullptr;
+    error = mError;
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace VulkanTutorial